@@ -16,6 +16,10 @@
 #include <zephyr/drivers/sensor.h>
 #include <zephyr/logging/log.h>
 
+#if defined(CONFIG_MPSL)
+#include <mpsl.h>
+#endif
+
 #include "adc.h"
 
 #define SAADC_CH_PSELP_PSELP_AnalogInput0   (1U)
@@ -47,6 +51,21 @@ static const struct divider_config divider_config = {
 	},
 };
 
+/* Raw to battery millivolt conversion, folded into one Q16 factor at build
+ * time: 0.6 V internal reference, 1/6 gain, 14-bit result and the divider.
+ */
+#define BATTERY_ADC_REF_MV	600
+#define BATTERY_ADC_GAIN_INV	6
+#define BATTERY_ADC_RESOLUTION	14
+#define BATTERY_MV_SCALE_Q16						\
+	((((uint64_t)BATTERY_ADC_REF_MV * BATTERY_ADC_GAIN_INV *		\
+	   CONFIG_PADLOCK_BATTERY_DIVIDER_FULL_OHM) <<			\
+	  (16 - BATTERY_ADC_RESOLUTION)) /					\
+	 CONFIG_PADLOCK_BATTERY_DIVIDER_OUTPUT_OHM)
+
+BUILD_ASSERT(BATTERY_MV_SCALE_Q16 * BIT(BATTERY_ADC_RESOLUTION) <= UINT32_MAX,
+	     "Battery scale factor overflows 32-bit math");
+
 struct divider_data {
 	const struct device *adc;
 	struct adc_channel_cfg adc_cfg;
@@ -101,7 +120,7 @@ int divider_setup(void)
 
 	accp->input_positive = SAADC_CH_PSELP_PSELP_AnalogInput0
 		+ iocp->channel;
-	asp->resolution = 14;
+	asp->resolution = BATTERY_ADC_RESOLUTION;
 
 	rc = adc_channel_setup(ddp->adc, accp);
 	printk("Setup AIN%u got %d", iocp->channel, rc);
@@ -134,38 +153,175 @@ int battery_measure_enable(bool enable)
 	return rc;
 }
 
-int battery_sample(void)
+static int battery_raw_to_mv(int16_t raw)
 {
-	int rc = -ENOENT;
+	/* Single ended inputs can read slightly negative around 0 V. */
+	if (raw < 0) {
+		return 0;
+	}
 
-	if (battery_ok) {
-		struct divider_data *ddp = &divider_data;
-		const struct divider_config *dcp = &divider_config;
-		struct adc_sequence *sp = &ddp->adc_seq;
-
-		rc = adc_read(ddp->adc, sp);
-		sp->calibrate = false;
-		if (rc == 0) {
-			int32_t val = ddp->raw;
-
-			adc_raw_to_millivolts(adc_ref_internal(ddp->adc),
-					      ddp->adc_cfg.gain,
-					      sp->resolution,
-					      &val);
-
-			if (dcp->output_ohm != 0) {
-				rc = val * (uint64_t)dcp->full_ohm
-					/ dcp->output_ohm;
-				printk("raw %u ~ %u mV => %d mV\n",
-					ddp->raw, val, rc);
-			} else {
-				rc = val;
-				printk("raw %u ~ %u mV\n", ddp->raw, val);
-			}
+	return ((uint32_t)raw * BATTERY_MV_SCALE_Q16 + BIT(15)) >> 16;
+}
+
+/* Periodic battery sampling. A conversion is started with adc_read_async()
+ * and its completion is picked up by a triggered work item, so neither the
+ * caller nor the work queue blocks on the SAADC.
+ */
+static battery_cb_t battery_cb;
+static struct k_poll_signal battery_sig;
+static struct k_poll_event battery_evt =
+	K_POLL_EVENT_STATIC_INITIALIZER(K_POLL_TYPE_SIGNAL,
+					K_POLL_MODE_NOTIFY_ONLY,
+					&battery_sig, 0);
+static struct k_work_poll battery_done_work;
+static void battery_sample_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(battery_sample_work, battery_sample_work_handler);
+
+static int battery_median[3];
+static uint8_t battery_median_cnt;
+static int32_t battery_ewma_q2;
+static atomic_t battery_mv = ATOMIC_INIT(-ENOENT);
+/* A conversion is in flight until battery_done_work has run. */
+static atomic_t battery_busy;
+static uint32_t calib_countdown;
+static int32_t calib_temp;
+
+static bool battery_calib_due(void)
+{
+	if (calib_countdown == 0) {
+		return true;
+	}
+	calib_countdown--;
+
+#if defined(CONFIG_MPSL)
+	/* The SAADC offset drifts with temperature, 0.25 degC units. */
+	int32_t temp = mpsl_temperature_get();
+
+	if (abs(temp - calib_temp) >=
+	    (CONFIG_PADLOCK_BATTERY_CALIB_TEMP_DELTA * 4)) {
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+static void battery_sample_work_handler(struct k_work *work)
+{
+	struct divider_data *ddp = &divider_data;
+	struct adc_sequence *sp = &ddp->adc_seq;
+	int rc;
+
+	/* battery_done_work schedules the next sample once this one is in. */
+	if (!atomic_cas(&battery_busy, 0, 1)) {
+		return;
+	}
+
+	if (battery_calib_due()) {
+		sp->calibrate = true;
+		calib_countdown = CONFIG_PADLOCK_BATTERY_CALIB_INTERVAL;
+#if defined(CONFIG_MPSL)
+		calib_temp = mpsl_temperature_get();
+#endif
+	}
+
+	k_poll_signal_reset(&battery_sig);
+	battery_evt.state = K_POLL_STATE_NOT_READY;
+
+	rc = adc_read_async(ddp->adc, sp, &battery_sig);
+	if (rc == 0) {
+		rc = k_work_poll_submit(&battery_done_work, &battery_evt, 1,
+					K_MSEC(100));
+	}
+
+	if (rc != 0) {
+		atomic_set(&battery_busy, 0);
+		k_work_schedule(&battery_sample_work,
+				K_SECONDS(CONFIG_PADLOCK_BATTERY_SAMPLE_INTERVAL_S));
+	}
+}
+
+static int median3(const int *v)
+{
+	if (v[0] > v[1]) {
+		if (v[1] > v[2]) {
+			return v[1];
 		}
+		return (v[0] > v[2]) ? v[2] : v[0];
+	}
+	if (v[0] > v[2]) {
+		return v[0];
 	}
+	return (v[1] > v[2]) ? v[2] : v[1];
+}
 
-	return rc;
+static void battery_done_work_handler(struct k_work *work)
+{
+	struct divider_data *ddp = &divider_data;
+	unsigned int signaled;
+	int result;
+	int mv;
+
+	k_poll_signal_check(&battery_sig, &signaled, &result);
+
+	atomic_set(&battery_busy, 0);
+	k_work_schedule(&battery_sample_work,
+			K_SECONDS(CONFIG_PADLOCK_BATTERY_SAMPLE_INTERVAL_S));
+
+	if (!signaled || (result != 0)) {
+		return;
+	}
+	ddp->adc_seq.calibrate = false;
+
+	mv = battery_raw_to_mv(ddp->raw);
+
+	/* Median of the last three samples rejects single spikes, the
+	 * moving average then smooths the remaining noise.
+	 */
+	if (battery_median_cnt == 0) {
+		battery_median[0] = battery_median[1] = battery_median[2] = mv;
+		battery_ewma_q2 = mv << 2;
+	}
+	battery_median[battery_median_cnt % 3] = mv;
+	battery_median_cnt++;
+
+	battery_ewma_q2 += median3(battery_median) - (battery_ewma_q2 >> 2);
+	mv = battery_ewma_q2 >> 2;
+
+	if ((atomic_set(&battery_mv, mv) != mv) && battery_cb) {
+		battery_cb(mv);
+	}
+}
+
+int battery_service_init(battery_cb_t cb)
+{
+	if (!battery_ok) {
+		return -ENOENT;
+	}
+
+	battery_cb = cb;
+	k_poll_signal_init(&battery_sig);
+	k_work_poll_init(&battery_done_work, battery_done_work_handler);
+	k_work_schedule(&battery_sample_work, K_NO_WAIT);
+
+	return 0;
+}
+
+void battery_sample_request(void)
+{
+	/* The sample in flight is as fresh as the requested one, and the
+	 * sequence and its signal must not be reused before it completes.
+	 */
+	if (atomic_get(&battery_busy)) {
+		return;
+	}
+
+	(void)k_work_reschedule(&battery_sample_work, K_NO_WAIT);
+}
+
+int battery_level_mv(void)
+{
+	return atomic_get(&battery_mv);
 }
 
 unsigned int battery_level_pptt(unsigned int batt_mV,
@@ -195,3 +351,66 @@ unsigned int battery_level_pptt(unsigned int batt_mV,
 		  * (batt_mV - pb->lvl_mV)
 		  / (pa->lvl_mV - pb->lvl_mV));
 }
+
+const struct battery_level_point battery_lipo_curve[] = {
+	{ 10000, 4200 },
+	{ 9500, 4150 },
+	{ 9000, 4110 },
+	{ 8500, 4080 },
+	{ 8000, 4020 },
+	{ 7500, 3980 },
+	{ 7000, 3950 },
+	{ 6500, 3910 },
+	{ 6000, 3870 },
+	{ 5500, 3840 },
+	{ 5000, 3820 },
+	{ 4500, 3800 },
+	{ 4000, 3790 },
+	{ 3500, 3770 },
+	{ 3000, 3750 },
+	{ 2500, 3730 },
+	{ 2000, 3710 },
+	{ 1500, 3690 },
+	{ 1000, 3610 },
+	{ 500, 3450 },
+	{ 0, 3300 },
+};
+
+/* battery_level_pptt() of battery_lipo_curve, sampled every 16 mV from
+ * SOC_TABLE_MIN_MV. Regenerate it whenever the curve changes.
+ */
+#define SOC_TABLE_MIN_MV	3296
+#define SOC_TABLE_STEP_SHIFT	4
+
+static const uint16_t soc_table[] = {
+	    0,    40,    93,   146,   200,   253,   306,   360,
+	  413,   466,   518,   568,   618,   668,   718,   768,
+	  818,   868,   918,   968,  1037,  1137,  1237,  1337,
+	 1437,  1650,  2050,  2450,  2850,  3250,  3650,  4100,
+	 4700,  5100,  5500,  5766,  6025,  6225,  6425,  6625,
+	 6825,  7033,  7300,  7550,  7750,  7950,  8100,  8233,
+	 8366,  8500,  8766,  9025,  9225,  9425,  9600,  9760,
+	 9920, 10000,
+};
+
+unsigned int battery_mv_to_pptt(unsigned int batt_mV)
+{
+	unsigned int idx;
+	unsigned int frac;
+
+	if (batt_mV <= SOC_TABLE_MIN_MV) {
+		return soc_table[0];
+	}
+
+	idx = (batt_mV - SOC_TABLE_MIN_MV) >> SOC_TABLE_STEP_SHIFT;
+	if (idx >= (ARRAY_SIZE(soc_table) - 1)) {
+		return soc_table[ARRAY_SIZE(soc_table) - 1];
+	}
+
+	/* Interpolate inside the bucket. */
+	frac = (batt_mV - SOC_TABLE_MIN_MV) & BIT_MASK(SOC_TABLE_STEP_SHIFT);
+
+	return soc_table[idx] +
+	       (((soc_table[idx + 1] - soc_table[idx]) * frac) >>
+		SOC_TABLE_STEP_SHIFT);
+}
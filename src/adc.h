@@ -17,12 +17,38 @@ int divider_setup(void);
  */
 int battery_measure_enable(bool enable);
 
-/** Measure the battery voltage.
+/** Callback for a change of the filtered battery voltage.
+ *
+ * Called from the system work queue.
+ *
+ * @param batt_mV the new filtered battery voltage in millivolts.
+ */
+typedef void (*battery_cb_t)(int batt_mV);
+
+/** Start periodic battery sampling.
+ *
+ * The battery is sampled every CONFIG_PADLOCK_BATTERY_SAMPLE_INTERVAL_S
+ * seconds without blocking. Samples are median and EWMA filtered.
+ *
+ * @param cb called when the filtered voltage changes, may be NULL.
+ *
+ * @return zero on success, or a negative error code.
+ */
+int battery_service_init(battery_cb_t cb);
+
+/** Take a sample as soon as possible instead of waiting for the next
+ * scheduled one.
+ */
+void battery_sample_request(void);
+
+/** Get the filtered battery voltage.
+ *
+ * Returns the cached value and never touches the ADC.
  *
  * @return the battery voltage in millivolts, or a negative error
- * code.
+ * code if no sample has completed yet.
  */
-int battery_sample(void);
+int battery_level_mv(void);
 
 /** A point in a battery discharge curve sequence.
  *
@@ -52,4 +78,19 @@ struct battery_level_point {
 unsigned int battery_level_pptt(unsigned int batt_mV,
 				const struct battery_level_point *curve);
 
+/** Discharge curve of the single cell LiPo battery fitted to the lock. */
+extern const struct battery_level_point battery_lipo_curve[];
+
+/** Estimate the battery level from a measured voltage in constant time.
+ *
+ * Uses a table precomputed from #battery_lipo_curve with 16 mV buckets,
+ * interpolated within the bucket. Integer math only.
+ *
+ * @param batt_mV a measured battery voltage level.
+ *
+ * @return the estimated remaining capacity in parts per ten
+ * thousand.
+ */
+unsigned int battery_mv_to_pptt(unsigned int batt_mV);
+
 #endif /* APPLICATION_BATTERY_H_ */
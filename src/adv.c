@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <string.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gap.h>
+
+#include "adv.h"
+
+#define DEVICE_NAME             CONFIG_BT_DEVICE_NAME
+#define DEVICE_NAME_LEN         (sizeof(DEVICE_NAME) - 1)
+
+/* Retry delay when the stack still holds the previous connection. */
+#define ADV_RETRY_MS		100
+
+/* Average of the random 0-10 ms delay added to every advertising event. */
+#define ADV_DELAY_AVG_US	5000
+
+#define ADV_FLAG_KICK		0
+#define ADV_FLAG_CONNECTED	1
+#define ADV_FLAG_RECONNECT	2
+
+/* Status beacon, in the advertising data so passive scanners see it. */
+enum {
+	BEACON_COMPANY_ID_LO,
+	BEACON_COMPANY_ID_HI,
+	BEACON_STATE,
+	BEACON_BATTERY,
+	BEACON_FLAGS,
+	BEACON_COUNTER,
+
+	BEACON_LEN,
+};
+
+static uint8_t beacon[BEACON_LEN] = {
+	[BEACON_COMPANY_ID_LO] = CONFIG_PADLOCK_BEACON_COMPANY_ID & 0xFF,
+	[BEACON_COMPANY_ID_HI] = CONFIG_PADLOCK_BEACON_COMPANY_ID >> 8,
+};
+
+static const struct bt_data ad[] = {
+	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
+	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
+	BT_DATA(BT_DATA_MANUFACTURER_DATA, beacon, sizeof(beacon)),
+};
+
+/* Each AD structure has a length and a type byte in front of its data. */
+BUILD_ASSERT((2 + 1) + (2 + DEVICE_NAME_LEN) + (2 + BEACON_LEN) <=
+	     BT_GAP_ADV_MAX_ADV_DATA_LEN,
+	     "Device name too long for the status beacon");
+
+static const struct bt_data sd[] = {
+	BT_DATA_BYTES(BT_DATA_UUID128_ALL,
+		      0x84, 0xaa, 0x60, 0x74, 0x52, 0x8a, 0x8b, 0x86,
+		      0xd3, 0x4c, 0xb7, 0x1d, 0x1d, 0xdc, 0x53, 0x8d),
+};
+
+/* Interval of high duty cycle directed advertising, at most 3.75 ms. */
+#define ADV_DIRECTED_INTERVAL	6
+
+static const struct adv_phase_cfg {
+	uint16_t interval_min;
+	uint16_t interval_max;
+	uint32_t duration_ms;
+} phase_cfg[] = {
+	[ADV_PHASE_DIRECTED] = {
+		ADV_DIRECTED_INTERVAL,
+		ADV_DIRECTED_INTERVAL,
+		0,
+	},
+	[ADV_PHASE_RECONNECT] = {
+		CONFIG_PADLOCK_ADV_FAST_INTERVAL_MIN,
+		CONFIG_PADLOCK_ADV_FAST_INTERVAL_MAX,
+		CONFIG_PADLOCK_ADV_RECONNECT_DURATION_S * MSEC_PER_SEC,
+	},
+	[ADV_PHASE_FAST] = {
+		CONFIG_PADLOCK_ADV_FAST_INTERVAL_MIN,
+		CONFIG_PADLOCK_ADV_FAST_INTERVAL_MAX,
+		CONFIG_PADLOCK_ADV_FAST_DURATION_S * MSEC_PER_SEC,
+	},
+	[ADV_PHASE_SLOW] = {
+		CONFIG_PADLOCK_ADV_SLOW_INTERVAL_MIN,
+		CONFIG_PADLOCK_ADV_SLOW_INTERVAL_MAX,
+		IS_ENABLED(CONFIG_PADLOCK_ADV_PAUSE) ?
+			CONFIG_PADLOCK_ADV_SLOW_DURATION_S * MSEC_PER_SEC : 0,
+	},
+};
+
+static atomic_t flags;
+static enum adv_phase phase = ADV_PHASE_PAUSED;
+static enum adv_phase retry_phase = ADV_PHASE_COUNT;
+static bt_addr_le_t peer_addr;
+static uint32_t phase_start;
+static struct adv_stats stats;
+static struct k_spinlock stats_lock;
+
+static struct adv_beacon beacon_next;
+static struct k_spinlock beacon_lock;
+
+static bool phase_is_advertising(enum adv_phase p)
+{
+	return p < ARRAY_SIZE(phase_cfg);
+}
+
+/* Average time between advertising events of a phase, in microseconds. */
+static uint32_t phase_event_us(enum adv_phase p)
+{
+	uint32_t us = (phase_cfg[p].interval_min + phase_cfg[p].interval_max) *
+		      625 / 2;
+
+	/* High duty cycle directed advertising has no random delay. */
+	return (p == ADV_PHASE_DIRECTED) ? us : (us + ADV_DELAY_AVG_US);
+}
+
+static void phase_account(struct adv_stats *out, uint32_t now)
+{
+	uint32_t elapsed = now - phase_start;
+
+	out->time_ms[phase] += elapsed;
+	if (phase_is_advertising(phase)) {
+		out->events[phase] += (uint64_t)elapsed * USEC_PER_MSEC /
+				      phase_event_us(phase);
+	}
+}
+
+static void phase_set(enum adv_phase next)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+	uint32_t now = k_uptime_get_32();
+
+	phase_account(&stats, now);
+	phase = next;
+	phase_start = now;
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+#if defined(CONFIG_BT_FILTER_ACCEPT_LIST)
+static void accept_list_add(const struct bt_bond_info *info, void *user_data)
+{
+	if (!bt_le_filter_accept_list_add(&info->addr)) {
+		(*(size_t *)user_data)++;
+	}
+}
+
+/* Fill the accept list with the bonded peers, returns their number. */
+static size_t accept_list_load(void)
+{
+	size_t count = 0;
+
+	(void)bt_le_filter_accept_list_clear();
+	bt_foreach_bond(BT_ID_DEFAULT, accept_list_add, &count);
+
+	return count;
+}
+#else
+static size_t accept_list_load(void)
+{
+	return 0;
+}
+#endif
+
+/* Whether a phase only accepts connections from bonded peers. */
+static bool phase_is_filtered(enum adv_phase p)
+{
+	return (p == ADV_PHASE_RECONNECT) ||
+	       ((p == ADV_PHASE_SLOW) &&
+		IS_ENABLED(CONFIG_PADLOCK_ADV_FILTER_IDLE));
+}
+
+static int adv_start(enum adv_phase p)
+{
+	struct bt_le_adv_param param = BT_LE_ADV_PARAM_INIT(
+		BT_LE_ADV_OPT_CONNECTABLE | BT_LE_ADV_OPT_ONE_TIME,
+		phase_cfg[p].interval_min, phase_cfg[p].interval_max, NULL);
+
+	if (p == ADV_PHASE_DIRECTED) {
+		/* High duty cycle, the stack ends it after 1.28 s. */
+		param.peer = &peer_addr;
+		param.interval_min = 0;
+		param.interval_max = 0;
+		return bt_le_adv_start(&param, NULL, 0, NULL, 0);
+	}
+
+	if (phase_is_filtered(p) && (accept_list_load() > 0)) {
+		param.options |= BT_LE_ADV_OPT_FILTER_CONN |
+				 BT_LE_ADV_OPT_FILTER_SCAN_REQ;
+	}
+
+	return bt_le_adv_start(&param, ad, ARRAY_SIZE(ad), sd, ARRAY_SIZE(sd));
+}
+
+static enum adv_phase next_phase(void)
+{
+	enum adv_phase next = retry_phase;
+
+	retry_phase = ADV_PHASE_COUNT;
+
+	if (atomic_test_and_clear_bit(&flags, ADV_FLAG_RECONNECT)) {
+		return ADV_PHASE_DIRECTED;
+	}
+
+	if (atomic_test_and_clear_bit(&flags, ADV_FLAG_KICK)) {
+		return ADV_PHASE_FAST;
+	}
+
+	if (next != ADV_PHASE_COUNT) {
+		return next;
+	}
+
+	switch (phase) {
+	case ADV_PHASE_DIRECTED:
+		return ADV_PHASE_RECONNECT;
+	case ADV_PHASE_RECONNECT:
+	case ADV_PHASE_FAST:
+		return ADV_PHASE_SLOW;
+	case ADV_PHASE_SLOW:
+		return IS_ENABLED(CONFIG_PADLOCK_ADV_PAUSE) ?
+		       ADV_PHASE_PAUSED : ADV_PHASE_COUNT;
+	default:
+		return ADV_PHASE_COUNT;
+	}
+}
+
+static void adv_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(adv_work, adv_work_fn);
+
+static void adv_work_fn(struct k_work *work)
+{
+	enum adv_phase next;
+	int err;
+
+	if (atomic_test_bit(&flags, ADV_FLAG_CONNECTED)) {
+		/* Advertising stopped by itself when the central connected. */
+		atomic_clear_bit(&flags, ADV_FLAG_KICK);
+		atomic_clear_bit(&flags, ADV_FLAG_RECONNECT);
+		retry_phase = ADV_PHASE_COUNT;
+		if (phase != ADV_PHASE_CONNECTED) {
+			phase_set(ADV_PHASE_CONNECTED);
+		}
+		return;
+	}
+
+	next = next_phase();
+	if (next == ADV_PHASE_COUNT) {
+		return;
+	}
+
+	if ((next == ADV_PHASE_FAST) && (phase == ADV_PHASE_FAST)) {
+		/* Already bursting, only extend the burst. */
+		k_work_reschedule(&adv_work, K_MSEC(phase_cfg[next].duration_ms));
+		return;
+	}
+
+	(void)bt_le_adv_stop();
+
+	if (phase_is_advertising(next)) {
+		err = adv_start(next);
+		if (err) {
+			stats.start_errors++;
+			retry_phase = next;
+			k_work_reschedule(&adv_work, K_MSEC(ADV_RETRY_MS));
+			return;
+		}
+	}
+
+	phase_set(next);
+
+	if (phase_is_advertising(next) && phase_cfg[next].duration_ms) {
+		k_work_reschedule(&adv_work, K_MSEC(phase_cfg[next].duration_ms));
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		/* Directed advertising timed out, or the connection could
+		 * not be established: move on, or restart the phase.
+		 */
+		if (phase != ADV_PHASE_DIRECTED) {
+			retry_phase = phase;
+		}
+		k_work_reschedule(&adv_work, K_NO_WAIT);
+		return;
+	}
+
+	atomic_set_bit(&flags, ADV_FLAG_CONNECTED);
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	const bt_addr_le_t *dst = bt_conn_get_dst(conn);
+
+	atomic_clear_bit(&flags, ADV_FLAG_CONNECTED);
+
+	if (IS_ENABLED(CONFIG_PADLOCK_ADV_RECONNECT) &&
+	    bt_addr_le_is_bonded(BT_ID_DEFAULT, dst)) {
+		bt_addr_le_copy(&peer_addr, dst);
+		atomic_set_bit(&flags, ADV_FLAG_RECONNECT);
+		k_work_reschedule(&adv_work, K_NO_WAIT);
+	} else {
+		adv_kick();
+	}
+}
+
+static void beacon_work_fn(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&beacon_lock);
+
+	beacon[BEACON_STATE] = beacon_next.state;
+	beacon[BEACON_BATTERY] = beacon_next.battery;
+	beacon[BEACON_FLAGS] = beacon_next.flags;
+
+	k_spin_unlock(&beacon_lock, key);
+
+	beacon[BEACON_COUNTER]++;
+
+	/* Otherwise the new payload goes out with the next advertising start. */
+	if ((phase == ADV_PHASE_RECONNECT) || (phase == ADV_PHASE_FAST) ||
+	    (phase == ADV_PHASE_SLOW)) {
+		(void)bt_le_adv_update_data(ad, ARRAY_SIZE(ad),
+					    sd, ARRAY_SIZE(sd));
+	}
+}
+
+static K_WORK_DEFINE(beacon_work, beacon_work_fn);
+
+BT_CONN_CB_DEFINE(adv_conn_callbacks) = {
+	.connected    = connected,
+	.disconnected = disconnected,
+};
+
+void adv_init(void)
+{
+	phase_start = k_uptime_get_32();
+	adv_kick();
+}
+
+void adv_kick(void)
+{
+	if (atomic_test_bit(&flags, ADV_FLAG_CONNECTED)) {
+		return;
+	}
+
+	atomic_set_bit(&flags, ADV_FLAG_KICK);
+	k_work_reschedule(&adv_work, K_NO_WAIT);
+}
+
+enum adv_phase adv_get_phase(void)
+{
+	return phase;
+}
+
+void adv_get_stats(struct adv_stats *out)
+{
+	k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+	*out = stats;
+	phase_account(out, k_uptime_get_32());
+
+	k_spin_unlock(&stats_lock, key);
+}
+
+void adv_beacon_update(const struct adv_beacon *status)
+{
+	k_spinlock_key_t key = k_spin_lock(&beacon_lock);
+	bool changed = memcmp(&beacon_next, status, sizeof(*status)) != 0;
+
+	beacon_next = *status;
+
+	k_spin_unlock(&beacon_lock, key);
+
+	if (changed) {
+		k_work_submit(&beacon_work);
+	}
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef ADV_H_
+#define ADV_H_
+
+/**@file
+ * @defgroup adv Advertising scheduler
+ * @{
+ * @brief Connectable advertising in fast, slow and paused phases.
+ *
+ * A fast burst runs after boot, a keypad press, a USB insertion and a
+ * disconnect, so a phone finds the padlock quickly. The scheduler then
+ * backs off to a slow interval and, if CONFIG_PADLOCK_ADV_PAUSE is set,
+ * stops advertising after a long period of inactivity until the next
+ * kick.
+ *
+ * When a bonded peer disconnects, the scheduler first advertises directed
+ * to it, then advertises at the fast interval with the filter accept list
+ * holding the bonded peers, before falling back to the slow phase. With
+ * CONFIG_PADLOCK_ADV_FILTER_IDLE the slow phase also filters, so only a
+ * kick opens the padlock to new phones.
+ *
+ * The advertising data carries a status beacon in manufacturer specific
+ * data, so gateways can follow the padlock by passive scanning:
+ *
+ * | Company ID (LE16) | State | Battery | Flags | Counter |
+ *
+ * State is a #lock_state, battery is the charge in tens of percent and
+ * flags are ADV_BEACON_F_* bits. The counter is incremented each time the
+ * payload changes, so a scanner can tell a new report from a repeat.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/sys/util.h>
+
+/** @brief Advertising phase. */
+enum adv_phase {
+	/** High duty cycle directed advertising to the last bonded peer. */
+	ADV_PHASE_DIRECTED,
+	/** Fast interval, only bonded peers may connect. */
+	ADV_PHASE_RECONNECT,
+	/** Fast interval burst. */
+	ADV_PHASE_FAST,
+	/** Slow interval, after the burst. */
+	ADV_PHASE_SLOW,
+	/** Not advertising, waiting for a kick. */
+	ADV_PHASE_PAUSED,
+	/** Not advertising, a central is connected. */
+	ADV_PHASE_CONNECTED,
+
+	ADV_PHASE_COUNT,
+};
+
+/** The shackle is out while the lock is locked. */
+#define ADV_BEACON_F_TAMPER	BIT(0)
+/** The last motor drive hit the maximum drive time. */
+#define ADV_BEACON_F_MOTOR_FAULT	BIT(1)
+/** USB power is present. */
+#define ADV_BEACON_F_CHARGING	BIT(2)
+/** The shackle is inserted. */
+#define ADV_BEACON_F_SHACKLE_IN	BIT(3)
+
+/** @brief Status carried by the advertising beacon. */
+struct adv_beacon {
+	/** Lock controller state, one of #lock_state. */
+	uint8_t state;
+	/** Battery charge in tens of percent, 0 to 10. */
+	uint8_t battery;
+	/** ADV_BEACON_F_* flags. */
+	uint8_t flags;
+};
+
+/** @brief Advertising statistics, indexed by #adv_phase. */
+struct adv_stats {
+	/** Estimated advertising events sent in each phase. */
+	uint32_t events[ADV_PHASE_COUNT];
+	/** Time spent in each phase, in milliseconds. */
+	uint32_t time_ms[ADV_PHASE_COUNT];
+	/** Advertising starts that failed and were retried. */
+	uint32_t start_errors;
+};
+
+/** @brief Start the scheduler with a fast burst.
+ *
+ * Must be called after bt_enable().
+ */
+void adv_init(void);
+
+/** @brief Restart the fast burst.
+ *
+ * Called on user activity. Ignored while a central is connected.
+ */
+void adv_kick(void);
+
+/** @brief Update the status beacon.
+ *
+ * The advertising data is only updated, and the counter incremented, when
+ * the status differs from the previous one.
+ *
+ * @param status New beacon status.
+ */
+void adv_beacon_update(const struct adv_beacon *status);
+
+/** @brief Get the current advertising phase. */
+enum adv_phase adv_get_phase(void);
+
+/** @brief Get a snapshot of the advertising statistics.
+ *
+ * The counters of the current phase include the time spent in it so far.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void adv_get_stats(struct adv_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* ADV_H_ */
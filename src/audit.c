@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/drivers/hwinfo.h>
+#include <errno.h>
+
+#include "audit.h"
+#include "cred.h"
+#include "storage.h"
+
+#define AUDIT_BATCH		CONFIG_PADLOCK_AUDIT_BATCH_RECORDS
+#define AUDIT_BLOCKS		CONFIG_PADLOCK_AUDIT_BLOCKS
+#define AUDIT_HDR_LEN		offsetof(struct audit_block, rec)
+
+BUILD_ASSERT(sizeof(struct audit_record) == 8, "Audit record is not packed");
+BUILD_ASSERT(STORAGE_ID_AUDIT_BASE + AUDIT_BLOCKS <= STORAGE_ID_AUDIT_END,
+	     "Too many audit log blocks");
+
+/* One block collects records while the other one is written to flash on
+ * the storage work queue.
+ */
+static struct audit_block batch[2];
+static uint8_t batch_count[2];
+static uint8_t fill;
+static uint8_t flush;
+static atomic_t flush_busy;
+
+static uint32_t next_seq;
+static uint32_t last_time;
+static struct k_spinlock lock;
+
+static struct audit_stats stats;
+
+static void flush_work_handler(struct k_work *work);
+static void flush_timeout_handler(struct k_work *work);
+
+static K_WORK_DEFINE(flush_work, flush_work_handler);
+static K_WORK_DELAYABLE_DEFINE(flush_timeout, flush_timeout_handler);
+
+static uint32_t uptime_s(void)
+{
+	return k_uptime_get() / MSEC_PER_SEC;
+}
+
+/* Hand the filling block to the storage work queue. Fails while the
+ * previous block is still being written.
+ */
+static bool batch_close(void)
+{
+	if (batch_count[fill] == 0) {
+		return true;
+	}
+
+	if (atomic_test_and_set_bit(&flush_busy, 0)) {
+		return false;
+	}
+
+	flush = fill;
+	fill ^= 1;
+	batch_count[fill] = 0;
+
+	storage_work_submit(&flush_work);
+
+	return true;
+}
+
+static void flush_work_handler(struct k_work *work)
+{
+	struct audit_block *blk = &batch[flush];
+	size_t len = AUDIT_HDR_LEN +
+		     batch_count[flush] * sizeof(struct audit_record);
+	k_spinlock_key_t key;
+	ssize_t rc;
+
+	rc = storage_write(STORAGE_ID_AUDIT_BASE + (blk->seq % AUDIT_BLOCKS),
+			   blk, len);
+	if (rc < 0) {
+		printk("Audit block write failed (err %d)\n", (int)rc);
+		stats.write_errors++;
+	} else {
+		stats.blocks_written++;
+	}
+
+	key = k_spin_lock(&lock);
+	atomic_clear_bit(&flush_busy, 0);
+
+	/* The other block filled up while this one was written. */
+	if (batch_count[fill] == AUDIT_BATCH) {
+		(void)batch_close();
+	}
+	k_spin_unlock(&lock, key);
+}
+
+static void flush_timeout_handler(struct k_work *work)
+{
+	audit_flush();
+}
+
+void audit_log(enum audit_evt evt, enum audit_src src, uint16_t user,
+	       uint16_t arg)
+{
+	uint32_t now = uptime_s();
+	struct audit_block *blk;
+	struct audit_record *rec;
+	k_spinlock_key_t key;
+	bool first;
+
+	key = k_spin_lock(&lock);
+
+	/* Start a new block rather than saturate the delta. */
+	if (batch_count[fill] && ((now - last_time) > UINT16_MAX)) {
+		(void)batch_close();
+	}
+
+	if (batch_count[fill] == AUDIT_BATCH) {
+		stats.dropped++;
+		k_spin_unlock(&lock, key);
+		return;
+	}
+
+	blk = &batch[fill];
+	first = (batch_count[fill] == 0);
+	if (first) {
+		blk->seq = next_seq++;
+		blk->time = cred_clock_get();
+		last_time = now;
+	}
+
+	rec = &blk->rec[batch_count[fill]++];
+	rec->evt = evt;
+	rec->src = src;
+	rec->delta = now - last_time;
+	rec->user = user;
+	rec->arg = arg;
+	last_time = now;
+	stats.records++;
+
+	if (batch_count[fill] == AUDIT_BATCH) {
+		(void)batch_close();
+	}
+
+	k_spin_unlock(&lock, key);
+
+	if (first) {
+		storage_work_schedule(&flush_timeout,
+				      K_SECONDS(CONFIG_PADLOCK_AUDIT_FLUSH_DELAY_S));
+	}
+}
+
+void audit_flush(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	(void)batch_close();
+
+	k_spin_unlock(&lock, key);
+}
+
+void audit_get_range(uint32_t *first, uint32_t *next)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	*next = next_seq;
+	*first = (next_seq > AUDIT_BLOCKS) ? (next_seq - AUDIT_BLOCKS) : 0;
+
+	k_spin_unlock(&lock, key);
+}
+
+int audit_read_block(uint32_t seq, struct audit_block *blk)
+{
+	ssize_t rc;
+
+	rc = storage_read(STORAGE_ID_AUDIT_BASE + (seq % AUDIT_BLOCKS), blk,
+			  sizeof(*blk));
+	if ((rc < (ssize_t)AUDIT_HDR_LEN) || (blk->seq != seq)) {
+		return -ENOENT;
+	}
+
+	return (MIN(rc, sizeof(*blk)) - AUDIT_HDR_LEN) /
+	       sizeof(struct audit_record);
+}
+
+void audit_get_stats(struct audit_stats *out)
+{
+	*out = stats;
+}
+
+void audit_init(void)
+{
+	struct audit_block hdr;
+	uint32_t last = 0;
+	bool found = false;
+	uint32_t cause;
+
+	/* Only the headers are read, so the scan is bounded by the number of
+	 * blocks whatever state the log was left in.
+	 */
+	for (size_t i = 0; i < AUDIT_BLOCKS; i++) {
+		ssize_t rc = storage_read(STORAGE_ID_AUDIT_BASE + i, &hdr,
+					  AUDIT_HDR_LEN);
+
+		if (rc < (ssize_t)AUDIT_HDR_LEN) {
+			continue;
+		}
+
+		if (!found || ((int32_t)(hdr.seq - last) > 0)) {
+			last = hdr.seq;
+			found = true;
+		}
+	}
+
+	next_seq = found ? (last + 1) : 0;
+
+	if (hwinfo_get_reset_cause(&cause)) {
+		cause = 0;
+	}
+	(void)hwinfo_clear_reset_cause();
+
+	audit_log(AUDIT_EVT_RESET, AUDIT_SRC_NONE, AUDIT_USER_NONE,
+		  cause & UINT16_MAX);
+}
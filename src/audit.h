@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef AUDIT_H_
+#define AUDIT_H_
+
+/**@file
+ * @defgroup audit Audit log
+ * @{
+ * @brief Circular log of lock events in flash.
+ *
+ * Events are 8 byte records, collected in RAM and written as one NVS
+ * entry per block of CONFIG_PADLOCK_AUDIT_BATCH_RECORDS records. Each
+ * block starts with a sequence number and the credential clock at its
+ * first record; every record stores the seconds elapsed since the
+ * previous record of the same block. The log keeps the last
+ * CONFIG_PADLOCK_AUDIT_BLOCKS blocks.
+ *
+ * A block is written when it is full, or CONFIG_PADLOCK_AUDIT_FLUSH_DELAY_S
+ * after its first record. NVS entries are written atomically, so a power
+ * loss costs at most the records still in RAM.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/toolchain.h>
+
+/** @brief Logged events. */
+enum audit_evt {
+	/** The lock booted, arg holds the RESET_* cause bits. */
+	AUDIT_EVT_RESET = 1,
+	/** The shackle was opened. */
+	AUDIT_EVT_UNLOCK,
+	/** The shackle was closed. */
+	AUDIT_EVT_LOCK,
+	/** A credential was rejected. */
+	AUDIT_EVT_AUTH_FAIL,
+	/** The motor hit its maximum drive time, arg holds the direction. */
+	AUDIT_EVT_MOTOR_STALL,
+	/** The credential clock was set. */
+	AUDIT_EVT_CLOCK_SET,
+	/** The shackle was found out of a locked lock. */
+	AUDIT_EVT_TAMPER,
+};
+
+/** @brief Origin of an event. */
+enum audit_src {
+	AUDIT_SRC_NONE,
+	/** Keypad entry. */
+	AUDIT_SRC_KEYPAD,
+	/** Bluetooth command. */
+	AUDIT_SRC_BLE,
+	/** The lock controller itself, e.g. a relock. */
+	AUDIT_SRC_AUTO,
+};
+
+/** User id of events not tied to a stored credential. */
+#define AUDIT_USER_NONE		0xFFFF
+/** User id of events authorized with the shared key. */
+#define AUDIT_USER_MASTER	0xFFFE
+
+/** @brief One log record, as stored in flash. */
+struct audit_record {
+	/** An #audit_evt. */
+	uint8_t evt;
+	/** An #audit_src. */
+	uint8_t src;
+	/** Seconds since the previous record of the block. */
+	uint16_t delta;
+	/** Credential owner, or AUDIT_USER_*. */
+	uint16_t user;
+	/** Event specific argument. */
+	uint16_t arg;
+} __packed;
+
+/** @brief One block of records, as stored in flash. */
+struct audit_block {
+	/** Block sequence number, increases by one per block. */
+	uint32_t seq;
+	/** Credential clock at the first record. */
+	uint32_t time;
+	/** Records, only the stored length is valid. */
+	struct audit_record rec[CONFIG_PADLOCK_AUDIT_BATCH_RECORDS];
+} __packed;
+
+/** @brief Audit log statistics. */
+struct audit_stats {
+	/** Records logged. */
+	uint32_t records;
+	/** Records lost because both blocks in RAM were full. */
+	uint32_t dropped;
+	/** Blocks written to flash. */
+	uint32_t blocks_written;
+	/** Blocks that could not be written. */
+	uint32_t write_errors;
+};
+
+/** @brief Find the end of the log and record the reset cause.
+ *
+ * Reads the header of every block once. Must be called after
+ * storage_init().
+ */
+void audit_init(void);
+
+/** @brief Log an event.
+ *
+ * Never blocks and is safe to call from any context, including
+ * interrupts. The flash write is done on the storage work queue.
+ *
+ * @param evt An #audit_evt.
+ * @param src An #audit_src.
+ * @param user Credential owner, or AUDIT_USER_*.
+ * @param arg Event specific argument.
+ */
+void audit_log(enum audit_evt evt, enum audit_src src, uint16_t user,
+	       uint16_t arg);
+
+/** @brief Write the records collected so far without waiting for the
+ *	   block to fill up.
+ */
+void audit_flush(void);
+
+/** @brief Get the range of block sequence numbers that may be stored.
+ *
+ * @param[out] first Oldest block that may still be stored.
+ * @param[out] next Sequence number of the block being collected.
+ */
+void audit_get_range(uint32_t *first, uint32_t *next);
+
+/** @brief Read a block from flash.
+ *
+ * @param seq Block sequence number.
+ * @param[out] blk Filled with the block.
+ *
+ * @return Number of records in the block, or -ENOENT if the block has been
+ *	   overwritten or was never written.
+ */
+int audit_read_block(uint32_t seq, struct audit_block *blk);
+
+/** @brief Get a snapshot of the audit log statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void audit_get_stats(struct audit_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* AUDIT_H_ */
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/crypto.h>
+#include <errno.h>
+#include <string.h>
+
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+#include <sdc_soc.h>
+#endif
+
+#include "auth.h"
+#include "ble.h"
+
+#define AES_BLOCK_LEN	16
+
+BUILD_ASSERT(BT_PADLOCK_NONCE_LEN == AES_BLOCK_LEN,
+	     "The nonce must be exactly one CMAC block");
+BUILD_ASSERT(AUTH_PAD_LEN == AES_BLOCK_LEN,
+	     "The pad is one encrypted block");
+
+static K_MUTEX_DEFINE(auth_lock);
+
+static uint8_t auth_key[AES_BLOCK_LEN];
+static uint8_t subkey1[AES_BLOCK_LEN];
+static uint8_t subkey2[AES_BLOCK_LEN];
+static bool subkeys_valid;
+
+/* Session material, valid while session_ready is set. */
+static uint8_t nonce[AES_BLOCK_LEN];
+static uint8_t nonce_enc[AES_BLOCK_LEN];	/* E(K, nonce) */
+static uint8_t nonce_mac[AES_BLOCK_LEN];	/* CMAC(K, nonce) */
+static atomic_t session_ready;
+static atomic_t connected_count;
+
+static struct auth_stats stats;
+
+/* Single block encryption, in the ECB peripheral when the SoftDevice
+ * Controller owns it, through the host crypto API otherwise.
+ */
+static int aes_encrypt(const uint8_t *in, uint8_t *out)
+{
+#if defined(CONFIG_BT_LL_SOFTDEVICE)
+	return sdc_soc_ecb_block_encrypt(auth_key, in, out);
+#else
+	return bt_encrypt_be(auth_key, in, out);
+#endif
+}
+
+static void block_xor(uint8_t *out, const uint8_t *a, const uint8_t *b)
+{
+	for (size_t i = 0; i < AES_BLOCK_LEN; i++) {
+		out[i] = a[i] ^ b[i];
+	}
+}
+
+/* RFC 4493 subkey generation step. */
+static void subkey_shift(uint8_t *out, const uint8_t *in)
+{
+	uint8_t msb = in[0] & 0x80;
+
+	for (size_t i = 0; i < (AES_BLOCK_LEN - 1); i++) {
+		out[i] = (in[i] << 1) | (in[i + 1] >> 7);
+	}
+	out[AES_BLOCK_LEN - 1] = (in[AES_BLOCK_LEN - 1] << 1) ^
+				 (msb ? 0x87 : 0x00);
+}
+
+static int subkeys_derive(void)
+{
+	static const uint8_t zero[AES_BLOCK_LEN];
+	uint8_t l[AES_BLOCK_LEN];
+	int err;
+
+	err = aes_encrypt(zero, l);
+	if (err) {
+		return err;
+	}
+
+	subkey_shift(subkey1, l);
+	subkey_shift(subkey2, subkey1);
+
+	return 0;
+}
+
+/* CMAC of nonce || msg, starting from the precomputed E(K, nonce). */
+static int cmac_finish(const uint8_t *msg, size_t len, uint8_t *mac)
+{
+	uint8_t x[AES_BLOCK_LEN];
+	uint8_t last[AES_BLOCK_LEN];
+	uint8_t block[AES_BLOCK_LEN];
+	int err;
+
+	if (len == 0) {
+		memcpy(mac, nonce_mac, AES_BLOCK_LEN);
+		return 0;
+	}
+
+	memcpy(x, nonce_enc, AES_BLOCK_LEN);
+
+	while (len > AES_BLOCK_LEN) {
+		block_xor(block, x, msg);
+		err = aes_encrypt(block, x);
+		if (err) {
+			return err;
+		}
+		msg += AES_BLOCK_LEN;
+		len -= AES_BLOCK_LEN;
+	}
+
+	if (len == AES_BLOCK_LEN) {
+		block_xor(last, msg, subkey1);
+	} else {
+		memset(last, 0, sizeof(last));
+		memcpy(last, msg, len);
+		last[len] = 0x80;
+		block_xor(last, last, subkey2);
+	}
+
+	block_xor(block, x, last);
+
+	return aes_encrypt(block, mac);
+}
+
+static void session_work_fn(struct k_work *work)
+{
+	uint32_t start = k_cycle_get_32();
+	uint8_t block[AES_BLOCK_LEN];
+	int err;
+
+	if (atomic_get(&connected_count) == 0) {
+		return;
+	}
+
+	k_mutex_lock(&auth_lock, K_FOREVER);
+
+	/* Derived here rather than in auth_set_key(), which may run
+	 * before the controller is enabled.
+	 */
+	err = subkeys_valid ? 0 : subkeys_derive();
+	if (!err) {
+		subkeys_valid = true;
+		err = bt_rand(nonce, sizeof(nonce));
+	}
+	if (!err) {
+		err = aes_encrypt(nonce, nonce_enc);
+	}
+	if (!err) {
+		/* A message of just the nonce is one complete block. */
+		block_xor(block, nonce, subkey1);
+		err = aes_encrypt(block, nonce_mac);
+	}
+	if (!err) {
+		atomic_set(&session_ready, 1);
+	}
+
+	k_mutex_unlock(&auth_lock);
+
+	stats.precompute_cycles = k_cycle_get_32() - start;
+
+	if (!err) {
+		(void)bt_padlock_set_nonce(nonce);
+	}
+}
+
+static K_WORK_DEFINE(session_work, session_work_fn);
+
+void auth_set_key(const uint8_t *key, size_t len)
+{
+	k_mutex_lock(&auth_lock, K_FOREVER);
+
+	atomic_set(&session_ready, 0);
+	memset(auth_key, 0, sizeof(auth_key));
+	memcpy(auth_key, key, MIN(len, sizeof(auth_key)));
+	subkeys_valid = false;
+
+	k_mutex_unlock(&auth_lock);
+
+	k_work_submit(&session_work);
+}
+
+bool auth_verify_pad(const uint8_t *msg, size_t len, const uint8_t *mac,
+		     uint8_t *pad)
+{
+	uint32_t start = k_cycle_get_32();
+	uint8_t expected[AES_BLOCK_LEN];
+	uint8_t diff = 0;
+	uint32_t cycles;
+	int err;
+
+	k_mutex_lock(&auth_lock, K_FOREVER);
+
+	if (!atomic_cas(&session_ready, 1, 0)) {
+		k_mutex_unlock(&auth_lock);
+		stats.failed++;
+		return false;
+	}
+
+	err = cmac_finish(msg, len, expected);
+	if (pad) {
+		/* E(K, nonce) never leaves the device, the MAC is a later
+		 * block of the chain.
+		 */
+		memcpy(pad, nonce_enc, AES_BLOCK_LEN);
+	}
+
+	k_mutex_unlock(&auth_lock);
+
+	/* Constant time compare, no early exit on the first mismatch. */
+	for (size_t i = 0; i < AUTH_MAC_LEN; i++) {
+		diff |= expected[i] ^ mac[i];
+	}
+
+	cycles = k_cycle_get_32() - start;
+	stats.verify_cycles_last = cycles;
+	stats.verify_cycles_max = MAX(stats.verify_cycles_max, cycles);
+
+	/* The nonce is single use, prepare the next one. */
+	k_work_submit(&session_work);
+
+	if (err || diff) {
+		stats.failed++;
+		return false;
+	}
+
+	stats.verified++;
+
+	return true;
+}
+
+bool auth_verify(const uint8_t *msg, size_t len, const uint8_t *mac)
+{
+	return auth_verify_pad(msg, len, mac, NULL);
+}
+
+/* The pad is E(K, nonce), the CBC state after the nonce block. The last
+ * block is held back until it is known whether more data follows.
+ */
+void auth_cmac_init(struct auth_cmac *ctx, const uint8_t *pad)
+{
+	memcpy(ctx->x, pad, AES_BLOCK_LEN);
+	ctx->len = 0;
+}
+
+int auth_cmac_update(struct auth_cmac *ctx, const uint8_t *data, size_t len)
+{
+	uint8_t block[AES_BLOCK_LEN];
+	size_t n;
+	int err = 0;
+
+	k_mutex_lock(&auth_lock, K_FOREVER);
+
+	while (len) {
+		if (ctx->len == AES_BLOCK_LEN) {
+			block_xor(block, ctx->x, ctx->block);
+			err = aes_encrypt(block, ctx->x);
+			if (err) {
+				break;
+			}
+			ctx->len = 0;
+		}
+
+		n = MIN(len, AES_BLOCK_LEN - ctx->len);
+		memcpy(&ctx->block[ctx->len], data, n);
+		ctx->len += n;
+		data += n;
+		len -= n;
+	}
+
+	k_mutex_unlock(&auth_lock);
+
+	return err ? -EIO : 0;
+}
+
+bool auth_cmac_verify(struct auth_cmac *ctx, const uint8_t *mac)
+{
+	uint8_t expected[AES_BLOCK_LEN];
+	uint8_t last[AES_BLOCK_LEN];
+	uint8_t diff = 0;
+	int err;
+
+	if (ctx->len == 0) {
+		return false;
+	}
+
+	k_mutex_lock(&auth_lock, K_FOREVER);
+
+	if (ctx->len == AES_BLOCK_LEN) {
+		block_xor(last, ctx->block, subkey1);
+	} else {
+		memset(last, 0, sizeof(last));
+		memcpy(last, ctx->block, ctx->len);
+		last[ctx->len] = 0x80;
+		block_xor(last, last, subkey2);
+	}
+
+	block_xor(last, ctx->x, last);
+	/* The subkeys are only missing right after a key change. */
+	err = subkeys_valid ? aes_encrypt(last, expected) : -EINVAL;
+
+	k_mutex_unlock(&auth_lock);
+
+	for (size_t i = 0; i < AUTH_MAC_LEN; i++) {
+		diff |= expected[i] ^ mac[i];
+	}
+
+	if (err || diff) {
+		stats.failed++;
+		return false;
+	}
+
+	stats.verified++;
+
+	return true;
+}
+
+void auth_get_stats(struct auth_stats *out)
+{
+	*out = stats;
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+
+	atomic_inc(&connected_count);
+	k_work_submit(&session_work);
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (atomic_dec(&connected_count) == 1) {
+		atomic_set(&session_ready, 0);
+	}
+}
+
+BT_CONN_CB_DEFINE(auth_conn_callbacks) = {
+	.connected    = connected,
+	.disconnected = disconnected,
+};
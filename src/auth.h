@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef AUTH_H_
+#define AUTH_H_
+
+/**@file
+ * @defgroup auth Challenge-response authentication
+ * @{
+ * @brief AES-CMAC authentication of command PDUs against a per-session
+ *	  nonce.
+ *
+ * On connect, and after each verification, a fresh 16 byte nonce is
+ * published on the Nonce characteristic. The client authenticates a
+ * command PDU with
+ *
+ *   MAC = AES-CMAC(key, nonce || PDU without the MAC operation)
+ *
+ * truncated to AUTH_MAC_LEN bytes. Each nonce is good for one
+ * verification.
+ *
+ * Secrets carried in an authenticated PDU are sent XORed with
+ * E(key, nonce), which is never sent over the air. The MAC is computed
+ * over the encrypted bytes.
+ *
+ * The nonce is the first CMAC block, so its encryption is precomputed
+ * together with the nonce while the link is idle. Verifying a short PDU
+ * then costs a single AES block on the write path.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Length of the truncated MAC carried in a PDU. */
+#define AUTH_MAC_LEN	8
+
+/** @brief Length of the one time pad of a verified PDU. */
+#define AUTH_PAD_LEN	16
+
+/** @brief Incremental CMAC of a long message, see auth_cmac_init(). */
+struct auth_cmac {
+	/** CBC state. */
+	uint8_t x[AUTH_PAD_LEN];
+	/** Last block, processed once more data follows or at the end. */
+	uint8_t block[AUTH_PAD_LEN];
+	/** Bytes held in @ref block. */
+	uint8_t len;
+};
+
+/** @brief Authentication statistics. */
+struct auth_stats {
+	/** MACs that matched. */
+	uint32_t verified;
+	/** MACs that did not match, or arrived without a valid nonce. */
+	uint32_t failed;
+	/** Cycles spent in the last verification. */
+	uint32_t verify_cycles_last;
+	/** Worst case cycles spent in a verification. */
+	uint32_t verify_cycles_max;
+	/** Cycles spent preparing the last session nonce. */
+	uint32_t precompute_cycles;
+};
+
+/** @brief Set the shared key.
+ *
+ * Keys shorter than 16 bytes are zero padded. Invalidates the current
+ * nonce and prepares a new one.
+ *
+ * @param key Key bytes.
+ * @param len Length of @p key, at most 16.
+ */
+void auth_set_key(const uint8_t *key, size_t len);
+
+/** @brief Verify the MAC of a message against the current nonce.
+ *
+ * The comparison runs in constant time. The nonce is consumed whatever
+ * the result, and a new one is prepared in the background.
+ *
+ * @param msg Authenticated message, without the nonce.
+ * @param len Length of @p msg.
+ * @param mac AUTH_MAC_LEN bytes received from the client.
+ *
+ * @retval true If the MAC matched.
+ */
+bool auth_verify(const uint8_t *msg, size_t len, const uint8_t *mac);
+
+/** @brief Verify the MAC of a message and get the pad of its nonce.
+ *
+ * Same as auth_verify(). On success @p pad holds E(key, nonce) for the
+ * consumed nonce, to decrypt secrets carried in @p msg. It is not set
+ * if the MAC did not match.
+ *
+ * @param msg Authenticated message, without the nonce.
+ * @param len Length of @p msg.
+ * @param mac AUTH_MAC_LEN bytes received from the client.
+ * @param[out] pad AUTH_PAD_LEN bytes, or NULL.
+ *
+ * @retval true If the MAC matched.
+ */
+bool auth_verify_pad(const uint8_t *msg, size_t len, const uint8_t *mac,
+		     uint8_t *pad);
+
+/** @brief Start an incremental CMAC bound to a verified nonce.
+ *
+ * Computes AES-CMAC(key, nonce || message) for a message too long to be
+ * held in RAM, where nonce is the one consumed by the auth_verify_pad()
+ * call that returned @p pad.
+ *
+ * @param ctx Context to initialize.
+ * @param pad Pad returned by auth_verify_pad().
+ */
+void auth_cmac_init(struct auth_cmac *ctx, const uint8_t *pad);
+
+/** @brief Add message bytes to an incremental CMAC.
+ *
+ * @param ctx Context from auth_cmac_init().
+ * @param data Message bytes.
+ * @param len Length of @p data.
+ *
+ * @retval 0 On success.
+ * @retval -EIO If the encryption failed.
+ */
+int auth_cmac_update(struct auth_cmac *ctx, const uint8_t *data, size_t len);
+
+/** @brief Finish an incremental CMAC and compare it with a received MAC.
+ *
+ * The comparison runs in constant time. A MAC computed while the key
+ * changed does not match.
+ *
+ * @param ctx Context from auth_cmac_init().
+ * @param mac AUTH_MAC_LEN bytes received from the client.
+ *
+ * @retval true If the MAC matched.
+ */
+bool auth_cmac_verify(struct auth_cmac *ctx, const uint8_t *mac);
+
+/** @brief Get a snapshot of the authentication statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void auth_get_stats(struct auth_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* AUTH_H_ */
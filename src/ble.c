@@ -12,6 +12,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <zephyr/sys/printk.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/kernel.h>
@@ -21,12 +22,35 @@
 #include <zephyr/bluetooth/conn.h>
 #include <zephyr/bluetooth/uuid.h>
 #include <zephyr/bluetooth/gatt.h>
+#include <zephyr/bluetooth/services/bas.h>
 
 #include "ble.h"
 
 bool                   notify_enabled;
 static uint32_t                   padlock_state;
 static struct bt_padlock_cb       padlock_cb;
+static bool                       result_notify_enabled;
+static bool                       nonce_notify_enabled;
+static bool                       prov_notify_enabled;
+static uint8_t                    nonce_value[BT_PADLOCK_NONCE_LEN];
+
+/* Status notification policy: lock state changes are sent at once, battery
+ * changes go through a deadband and a minimum interval, and everything that
+ * arrives inside one interval is sent as a single notification.
+ */
+#define STATUS_LOCK_MASK	0x0000FFFFU
+#define STATUS_BATTERY(s)	((s) >> 16)
+
+static struct k_spinlock          notify_lock;
+static uint32_t                   notify_last;
+static uint32_t                   notify_pending;
+static int64_t                    notify_last_time;
+static bool                       notify_valid;
+static bool                       notify_queued;
+static struct bt_padlock_notify_stats notify_stats;
+
+static void notify_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(notify_work, notify_work_handler);
 
 //const struct bt_gatt_attr attr_padlock_svc;
 //const struct bt_gatt_service_static padlock_svc = {.attrs = &attr_padlock_svc, .attr_count = 6U};
@@ -34,10 +58,34 @@ static struct bt_padlock_cb       padlock_cb;
 static void padlocklc_ccc_cfg_changed(const struct bt_gatt_attr *attr,
 				  uint16_t value)
 {
+	k_spinlock_key_t key = k_spin_lock(&notify_lock);
+
 	notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+	/* The next status update is always sent to a new subscriber. */
+	notify_valid = false;
+	k_spin_unlock(&notify_lock, key);
+
 	printk("Notify Enable: %d", notify_enabled);
 }
 
+static void padlock_result_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+					   uint16_t value)
+{
+	result_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+static void padlock_nonce_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+					  uint16_t value)
+{
+	nonce_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
+static void padlock_prov_ccc_cfg_changed(const struct bt_gatt_attr *attr,
+					 uint16_t value)
+{
+	prov_notify_enabled = (value == BT_GATT_CCC_NOTIFY);
+}
+
 static ssize_t write_padlock_key(struct bt_conn *conn,
 			 const struct bt_gatt_attr *attr,
 			 const void *buf,
@@ -57,8 +105,61 @@ static ssize_t write_padlock_key(struct bt_conn *conn,
 	}
 
 	if (padlock_cb.key_cb) {
-		uint8_t* val = (uint8_t *)buf;
-		padlock_cb.key_cb(val, len);
+		int err = padlock_cb.key_cb(buf, len);
+
+		if (err == -ENOMEM) {
+			return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+		} else if (err) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+	}
+
+	return len;
+}
+
+static ssize_t write_padlock_cmd(struct bt_conn *conn,
+			 const struct bt_gatt_attr *attr,
+			 const void *buf,
+			 uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (padlock_cb.cmd_cb) {
+		int err = padlock_cb.cmd_cb(buf, len);
+
+		if (err == -ENOMEM) {
+			return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+		} else if (err == -EACCES) {
+			return BT_GATT_ERR(BT_ATT_ERR_AUTHENTICATION);
+		} else if (err) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
+	}
+
+	return len;
+}
+
+static ssize_t write_padlock_prov(struct bt_conn *conn,
+				  const struct bt_gatt_attr *attr,
+				  const void *buf,
+				  uint16_t len, uint16_t offset, uint8_t flags)
+{
+	if (offset != 0) {
+		return BT_GATT_ERR(BT_ATT_ERR_INVALID_OFFSET);
+	}
+
+	if (padlock_cb.prov_cb) {
+		int err = padlock_cb.prov_cb(buf, len);
+
+		if (err == -ENOMEM) {
+			return BT_GATT_ERR(BT_ATT_ERR_INSUFFICIENT_RESOURCES);
+		} else if (err == -EACCES) {
+			return BT_GATT_ERR(BT_ATT_ERR_AUTHENTICATION);
+		} else if (err) {
+			return BT_GATT_ERR(BT_ATT_ERR_VALUE_NOT_ALLOWED);
+		}
 	}
 
 	return len;
@@ -84,6 +185,16 @@ static ssize_t read_padlock_status(struct bt_conn *conn,
 	return 0;
 }
 
+static ssize_t read_padlock_nonce(struct bt_conn *conn,
+				  const struct bt_gatt_attr *attr,
+				  void *buf,
+				  uint16_t len,
+				  uint16_t offset)
+{
+	return bt_gatt_attr_read(conn, attr, buf, len, offset, attr->user_data,
+				 BT_PADLOCK_NONCE_LEN);
+}
+
 /* LED Button Service Declaration */
 BT_GATT_SERVICE_DEFINE(padlock_svc,
 BT_GATT_PRIMARY_SERVICE(BT_UUID_PADLOCK),
@@ -97,6 +208,30 @@ BT_GATT_PRIMARY_SERVICE(BT_UUID_PADLOCK),
 			       BT_GATT_CHRC_WRITE,
 			       BT_GATT_PERM_WRITE,
 			       NULL, write_padlock_key, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_PADLOCK_RESULT,
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_NONE, NULL, NULL, NULL),
+	BT_GATT_CCC(padlock_result_ccc_cfg_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_PADLOCK_CMD,
+			       BT_GATT_CHRC_WRITE |
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP,
+			       BT_GATT_PERM_WRITE,
+			       NULL, write_padlock_cmd, NULL),
+	BT_GATT_CHARACTERISTIC(BT_UUID_PADLOCK_NONCE,
+			       BT_GATT_CHRC_READ | BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_READ, read_padlock_nonce,
+			       NULL, nonce_value),
+	BT_GATT_CCC(padlock_nonce_ccc_cfg_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
+	BT_GATT_CHARACTERISTIC(BT_UUID_PADLOCK_PROV,
+			       BT_GATT_CHRC_WRITE |
+			       BT_GATT_CHRC_WRITE_WITHOUT_RESP |
+			       BT_GATT_CHRC_NOTIFY,
+			       BT_GATT_PERM_WRITE,
+			       NULL, write_padlock_prov, NULL),
+	BT_GATT_CCC(padlock_prov_ccc_cfg_changed,
+		    BT_GATT_PERM_READ | BT_GATT_PERM_WRITE),
 );
 
 int bt_padlock_init(struct bt_padlock_cb *callbacks)
@@ -104,6 +239,8 @@ int bt_padlock_init(struct bt_padlock_cb *callbacks)
 	if (callbacks) {
 		padlock_cb.status_cb    = callbacks->status_cb;
 		padlock_cb.key_cb = callbacks->key_cb;
+		padlock_cb.cmd_cb = callbacks->cmd_cb;
+		padlock_cb.prov_cb = callbacks->prov_cb;
 	}
 
 	return 0;
@@ -119,3 +256,147 @@ int bt_padlock_send_button_state(uint32_t button_state)
 			      &button_state,
 			      sizeof(button_state));
 }
+
+int bt_padlock_send_result(const uint8_t *result, uint16_t len)
+{
+	if (!result_notify_enabled) {
+		return -EACCES;
+	}
+
+	return bt_gatt_notify(NULL, &padlock_svc.attrs[7], result, len);
+}
+
+int bt_padlock_set_nonce(const uint8_t *nonce)
+{
+	memcpy(nonce_value, nonce, sizeof(nonce_value));
+
+	if (!nonce_notify_enabled) {
+		return -EACCES;
+	}
+
+	return bt_gatt_notify(NULL, &padlock_svc.attrs[12], nonce_value,
+			      sizeof(nonce_value));
+}
+
+int bt_padlock_send_prov_result(const uint8_t *result, uint16_t len)
+{
+	if (!prov_notify_enabled) {
+		return -EACCES;
+	}
+
+	return bt_gatt_notify(NULL, &padlock_svc.attrs[15], result, len);
+}
+
+static void notify_send(uint32_t status)
+{
+	notify_last = status;
+	notify_last_time = k_uptime_get();
+	notify_valid = true;
+	notify_queued = false;
+	notify_stats.sent++;
+}
+
+static void notify_work_handler(struct k_work *work)
+{
+	k_spinlock_key_t key = k_spin_lock(&notify_lock);
+	uint32_t status = notify_pending;
+	bool send = notify_queued;
+
+	if (send) {
+		notify_send(status);
+	}
+	k_spin_unlock(&notify_lock, key);
+
+	if (send) {
+		(void)bt_padlock_send_button_state(status);
+	}
+}
+
+int bt_padlock_status_update(uint32_t status)
+{
+	k_spinlock_key_t key;
+	uint32_t batt_delta;
+	int64_t wait;
+
+	key = k_spin_lock(&notify_lock);
+
+	padlock_state = status;
+
+	if (!notify_enabled) {
+		k_spin_unlock(&notify_lock, key);
+		return -EACCES;
+	}
+
+	if (notify_valid && (status == notify_last)) {
+		/* Back to the value the client already has. */
+		notify_queued = false;
+		k_spin_unlock(&notify_lock, key);
+		return 0;
+	}
+
+	if (!notify_valid ||
+	    ((status & STATUS_LOCK_MASK) != (notify_last & STATUS_LOCK_MASK))) {
+		notify_send(status);
+		k_spin_unlock(&notify_lock, key);
+		(void)k_work_cancel_delayable(&notify_work);
+
+		return bt_padlock_send_button_state(status);
+	}
+
+	batt_delta = abs((int)STATUS_BATTERY(status) -
+			 (int)STATUS_BATTERY(notify_last));
+	if (batt_delta < CONFIG_PADLOCK_NOTIFY_BATTERY_DEADBAND_MV) {
+		/* A send already scheduled goes out with the latest value. */
+		if (notify_queued) {
+			notify_pending = status;
+			notify_stats.coalesced++;
+		} else {
+			notify_stats.suppressed++;
+		}
+		k_spin_unlock(&notify_lock, key);
+		return 0;
+	}
+
+	if (notify_queued) {
+		notify_stats.coalesced++;
+	}
+	notify_pending = status;
+	notify_queued = true;
+
+	wait = notify_last_time + CONFIG_PADLOCK_NOTIFY_MIN_INTERVAL_MS -
+	       k_uptime_get();
+	k_spin_unlock(&notify_lock, key);
+
+	/* Keeps an already scheduled send, so a burst goes out once. */
+	k_work_schedule(&notify_work, K_MSEC(MAX(wait, 0)));
+
+	return 0;
+}
+
+void bt_padlock_get_notify_stats(struct bt_padlock_notify_stats *stats)
+{
+	k_spinlock_key_t key = k_spin_lock(&notify_lock);
+
+	*stats = notify_stats;
+	k_spin_unlock(&notify_lock, key);
+}
+
+int bt_padlock_battery_update(unsigned int pptt)
+{
+	static int reported = -1;
+	int lower;
+	int upper;
+
+	/* Only move to a new whole percent once the level has left the
+	 * current one by more than the hysteresis.
+	 */
+	lower = reported * 100 - CONFIG_PADLOCK_BAS_HYSTERESIS_PPTT;
+	upper = (reported + 1) * 100 + CONFIG_PADLOCK_BAS_HYSTERESIS_PPTT;
+	if ((reported >= 0) && ((int)pptt >= lower) && ((int)pptt < upper)) {
+		return 0;
+	}
+
+	reported = MIN(pptt / 100, 100);
+
+	return bt_bas_set_battery_level(reported);
+}
@@ -27,13 +27,53 @@
 #define BT_UUID_PADLOCK_KEY_VAL \
 	BT_UUID_128_ENCODE(0x00001525, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
 
+/** @brief Command Result Characteristic UUID. */
+#define BT_UUID_PADLOCK_RESULT_VAL \
+	BT_UUID_128_ENCODE(0x00001526, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+/** @brief TLV Command Characteristic UUID. */
+#define BT_UUID_PADLOCK_CMD_VAL \
+	BT_UUID_128_ENCODE(0x00001527, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+/** @brief Authentication Nonce Characteristic UUID. */
+#define BT_UUID_PADLOCK_NONCE_VAL \
+	BT_UUID_128_ENCODE(0x00001528, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
+/** @brief Provisioning Characteristic UUID. */
+#define BT_UUID_PADLOCK_PROV_VAL \
+	BT_UUID_128_ENCODE(0x00001529, 0x1212, 0xefde, 0x1523, 0x785feabcd123)
+
 
 #define BT_UUID_PADLOCK           BT_UUID_DECLARE_128(BT_UUID_PADLOCK_VAL)
 #define BT_UUID_PADLOCK_STATUS    BT_UUID_DECLARE_128(BT_UUID_PADLOCK_STATUS_VAL)
 #define BT_UUID_PADLOCK_KEY       BT_UUID_DECLARE_128(BT_UUID_PADLOCK_KEY_VAL)
+#define BT_UUID_PADLOCK_RESULT    BT_UUID_DECLARE_128(BT_UUID_PADLOCK_RESULT_VAL)
+#define BT_UUID_PADLOCK_CMD       BT_UUID_DECLARE_128(BT_UUID_PADLOCK_CMD_VAL)
+#define BT_UUID_PADLOCK_NONCE     BT_UUID_DECLARE_128(BT_UUID_PADLOCK_NONCE_VAL)
+#define BT_UUID_PADLOCK_PROV      BT_UUID_DECLARE_128(BT_UUID_PADLOCK_PROV_VAL)
 
-/** @brief Callback type for when an LED state change is received. */
-typedef void (*key_cb_t)(uint8_t* buf, uint16_t length);
+/** @brief Length of the authentication nonce. */
+#define BT_PADLOCK_NONCE_LEN      16
+
+/** @brief Callback type for when a key frame is written.
+ *
+ * Return 0 to accept the write, -ENOMEM if the command could not be
+ * queued, or another negative error code if the frame is invalid.
+ */
+typedef int (*key_cb_t)(const uint8_t *buf, uint16_t length);
+
+/** @brief Callback type for when a TLV command PDU is written.
+ *
+ * Same return values as #key_cb_t, plus -EACCES if the PDU failed
+ * authentication.
+ */
+typedef int (*cmd_cb_t)(const uint8_t *buf, uint16_t length);
+
+/** @brief Callback type for when a provisioning PDU is written.
+ *
+ * Same return values as #cmd_cb_t.
+ */
+typedef int (*prov_cb_t)(const uint8_t *buf, uint16_t length);
 
 /** @brief Callback type for when the button state is pulled. */
 typedef uint32_t (*status_cb_t)(void);
@@ -42,6 +82,10 @@ typedef uint32_t (*status_cb_t)(void);
 struct bt_padlock_cb {
 	/** key send callback. */
 	key_cb_t    key_cb;
+	/** TLV command write callback. */
+	cmd_cb_t    cmd_cb;
+	/** Provisioning write callback. */
+	prov_cb_t   prov_cb;
 	/** lock status read callback. */
 	status_cb_t status_cb;
 };
@@ -77,6 +121,86 @@ int bt_padlock_init(struct bt_padlock_cb *callbacks);
  */
 int bt_padlock_send_button_state(uint32_t button_state);
 
+/** @brief Send a command completion result.
+ *
+ * Notifies the result of a command batch on the Command Result
+ * characteristic.
+ *
+ * @param[in] result Encoded batch result.
+ * @param[in] len Length of @p result.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_padlock_send_result(const uint8_t *result, uint16_t len);
+
+/** @brief Publish a new authentication nonce.
+ *
+ * The nonce is readable on the Nonce characteristic and notified to a
+ * subscribed client.
+ *
+ * @param[in] nonce BT_PADLOCK_NONCE_LEN bytes.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_padlock_set_nonce(const uint8_t *nonce);
+
+/** @brief Send a provisioning result.
+ *
+ * @param[in] result Encoded result.
+ * @param[in] len Length of @p result.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_padlock_send_prov_result(const uint8_t *result, uint16_t len);
+
+/** @brief Status notification statistics. */
+struct bt_padlock_notify_stats {
+	/** Notifications sent. */
+	uint32_t sent;
+	/** Battery changes dropped because they were inside the deadband. */
+	uint32_t suppressed;
+	/** Updates merged into an already pending notification. */
+	uint32_t coalesced;
+};
+
+/** @brief Update the padlock status.
+ *
+ * Applies the notification policy: a lock state change is notified at
+ * once, a battery change only if it exceeds
+ * CONFIG_PADLOCK_NOTIFY_BATTERY_DEADBAND_MV, and no more often than every
+ * CONFIG_PADLOCK_NOTIFY_MIN_INTERVAL_MS. Updates inside one interval are
+ * coalesced into a single notification carrying the latest value.
+ *
+ * @param[in] status Lock state in the low 16 bits, battery millivolts in
+ *		     the high 16 bits.
+ *
+ * @retval 0 If the update was sent, deferred or suppressed.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_padlock_status_update(uint32_t status);
+
+/** @brief Get the status notification statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void bt_padlock_get_notify_stats(struct bt_padlock_notify_stats *stats);
+
+/** @brief Update the standard Battery Service level.
+ *
+ * The Battery Level characteristic only changes, and is only notified,
+ * when the level moves to another whole percent by more than
+ * CONFIG_PADLOCK_BAS_HYSTERESIS_PPTT.
+ *
+ * @param[in] pptt Battery level in parts per ten thousand.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int bt_padlock_battery_update(unsigned int pptt);
+
 /**
  * @}
  */
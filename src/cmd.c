@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <errno.h>
+#include <string.h>
+
+#include "cmd.h"
+#include "ble.h"
+#include "auth.h"
+#include "audit.h"
+
+#define CMD_FRAME_LEN		8
+#define CMD_FRAME_HEADER	0x55
+#define CMD_TLV_HDR_LEN		2
+#define CMD_RESULT_MAX_LEN	20
+#define CMD_TLV_MAX_LEN		(CMD_TLV_HDR_LEN + \
+				 CONFIG_PADLOCK_CMD_BATCH_MAX_OPS * \
+				 (2 + sizeof(((struct padlock_cmd *)0)->data)))
+
+/* A batch is queued and executed as one unit. */
+struct cmd_batch {
+	uint32_t submit_time;
+	uint8_t seq;
+	uint8_t count;
+	/* Operations that need authentication run without a prior AUTH. */
+	bool preauth;
+	struct padlock_cmd cmds[CONFIG_PADLOCK_CMD_BATCH_MAX_OPS];
+};
+
+/* Who may run an operation. A MAC verified batch counts as the master,
+ * the MAC is keyed with the master key.
+ */
+enum cmd_auth {
+	CMD_AUTH_NONE,
+	CMD_AUTH_USER,
+	CMD_AUTH_MASTER,
+};
+
+/* Operations accepted in a TLV PDU. */
+static const struct cmd_op_desc {
+	uint8_t op;
+	uint8_t min_len;
+	uint8_t max_len;
+	uint8_t auth;
+} cmd_ops[] = {
+	{ PADLOCK_CMD_AUTH,        6, 6, CMD_AUTH_NONE },
+	{ PADLOCK_CMD_AUTH_MAC,    AUTH_MAC_LEN, AUTH_MAC_LEN, CMD_AUTH_NONE },
+	{ PADLOCK_CMD_UNLOCK,      0, 0, CMD_AUTH_USER },
+	{ PADLOCK_CMD_LOCK,        0, 0, CMD_AUTH_USER },
+	{ PADLOCK_CMD_KEY_UPDATE,  6, 6, CMD_AUTH_MASTER },
+	{ PADLOCK_CMD_AUTO_CLOSE,  1, 1, CMD_AUTH_USER },
+	{ PADLOCK_CMD_READ_STATUS, 0, 0, CMD_AUTH_NONE },
+	{ PADLOCK_CMD_CRED_REVOKE, 2, 2, CMD_AUTH_MASTER },
+	{ PADLOCK_CMD_CLOCK_SET,   4, 4, CMD_AUTH_MASTER },
+};
+
+/* Legacy 8 byte frames, keyed by their trailer byte. KEY_UPDATE is not
+ * accepted: its frame has no room for the old key, so any peer could
+ * replace the key.
+ */
+#define LEGACY_KEY_IN_DATA	BIT(0)	/* Payload is the key, check it first. */
+#define LEGACY_LAST_BYTE	BIT(1)	/* Only the last payload byte is used. */
+
+static const struct cmd_legacy_desc {
+	uint8_t trailer;
+	uint8_t flags;
+} cmd_legacy[] = {
+	{ PADLOCK_CMD_UNLOCK,     LEGACY_KEY_IN_DATA },
+	{ PADLOCK_CMD_LOCK,       LEGACY_KEY_IN_DATA },
+	{ PADLOCK_CMD_AUTO_CLOSE, LEGACY_LAST_BYTE },
+};
+
+K_MSGQ_DEFINE(cmd_msgq, sizeof(struct cmd_batch),
+	      CONFIG_PADLOCK_CMD_QUEUE_SIZE, 4);
+
+static const struct padlock_cmd_handler *cmd_handlers;
+static size_t cmd_handler_count;
+static struct padlock_cmd_stats stats;
+static uint8_t cmd_seq;
+
+void padlock_cmd_init(const struct padlock_cmd_handler *handlers,
+		      size_t count)
+{
+	cmd_handlers = handlers;
+	cmd_handler_count = count;
+}
+
+static const struct cmd_op_desc *cmd_op_find(uint8_t op)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cmd_ops); i++) {
+		if (cmd_ops[i].op == op) {
+			return &cmd_ops[i];
+		}
+	}
+
+	return NULL;
+}
+
+static void cmd_reject(uint8_t seq, enum padlock_cmd_status status)
+{
+	uint8_t result[] = { seq, 0x00, status };
+
+	(void)bt_padlock_send_result(result, sizeof(result));
+}
+
+static int cmd_batch_queue(struct cmd_batch *batch)
+{
+	batch->submit_time = k_uptime_get_32();
+
+	if (k_msgq_put(&cmd_msgq, batch, K_NO_WAIT)) {
+		stats.rejected++;
+		cmd_reject(batch->seq, PADLOCK_CMD_STATUS_QUEUE_FULL);
+		return -ENOMEM;
+	}
+	stats.submitted++;
+
+	return 0;
+}
+
+int padlock_cmd_submit_frame(const uint8_t *buf, uint16_t len)
+{
+	const struct cmd_legacy_desc *desc = NULL;
+	struct cmd_batch batch = { .seq = cmd_seq++ };
+	struct padlock_cmd *cmd = &batch.cmds[0];
+
+	if ((len == CMD_FRAME_LEN) && (buf[0] == CMD_FRAME_HEADER)) {
+		for (size_t i = 0; i < ARRAY_SIZE(cmd_legacy); i++) {
+			if (cmd_legacy[i].trailer == buf[CMD_FRAME_LEN - 1]) {
+				desc = &cmd_legacy[i];
+				break;
+			}
+		}
+	}
+
+	if (!desc || !IS_ENABLED(CONFIG_PADLOCK_AUTH_PLAIN_KEY)) {
+		stats.invalid++;
+		return -EINVAL;
+	}
+
+	/* Frames carrying the key become AUTH + operation; the others were
+	 * never authenticated and keep working as before.
+	 */
+	if (desc->flags & LEGACY_KEY_IN_DATA) {
+		cmd->op = PADLOCK_CMD_AUTH;
+		cmd->flags = PADLOCK_CMD_F_SILENT;
+		cmd->len = sizeof(cmd->data);
+		memcpy(cmd->data, &buf[1], sizeof(cmd->data));
+		cmd++;
+	} else {
+		batch.preauth = true;
+	}
+
+	cmd->op = desc->trailer;
+	if (desc->flags & LEGACY_LAST_BYTE) {
+		cmd->len = 1;
+		cmd->data[0] = buf[CMD_FRAME_LEN - 2];
+	}
+	batch.count = (cmd - batch.cmds) + 1;
+
+	return cmd_batch_queue(&batch);
+}
+
+/* The MAC covers version, sequence number and the operations after it. */
+static bool cmd_mac_verify(const uint8_t *buf, uint16_t len,
+			   const uint8_t *mac, uint8_t *pad)
+{
+	uint8_t msg[CMD_TLV_MAX_LEN];
+	uint16_t ops_off = CMD_TLV_HDR_LEN + 2 + AUTH_MAC_LEN;
+	uint16_t ops_len = len - ops_off;
+
+	if ((CMD_TLV_HDR_LEN + ops_len) > sizeof(msg)) {
+		return false;
+	}
+
+	memcpy(msg, buf, CMD_TLV_HDR_LEN);
+	memcpy(&msg[CMD_TLV_HDR_LEN], &buf[ops_off], ops_len);
+
+	return auth_verify_pad(msg, CMD_TLV_HDR_LEN + ops_len, mac, pad);
+}
+
+int padlock_cmd_submit_tlv(const uint8_t *buf, uint16_t len)
+{
+	struct cmd_batch batch = { 0 };
+	uint16_t off = CMD_TLV_HDR_LEN;
+	const uint8_t *mac = NULL;
+	uint8_t pad[AUTH_PAD_LEN];
+
+	if ((len < CMD_TLV_HDR_LEN) || (buf[0] != PADLOCK_TLV_VERSION)) {
+		stats.invalid++;
+		return -EINVAL;
+	}
+	batch.seq = buf[1];
+
+	/* Validate the whole PDU before anything is queued. */
+	while (off < len) {
+		const struct cmd_op_desc *desc;
+		struct padlock_cmd *cmd;
+		uint8_t op_len;
+
+		if (((len - off) < 2) ||
+		    (batch.count == ARRAY_SIZE(batch.cmds))) {
+			goto invalid;
+		}
+
+		desc = cmd_op_find(buf[off]);
+		op_len = buf[off + 1];
+		if (!desc || (op_len < desc->min_len) ||
+		    (op_len > desc->max_len) || (op_len > (len - off - 2))) {
+			goto invalid;
+		}
+
+		/* The MAC must come first, it covers everything after it. It is
+		 * verified straight from the PDU and is not an operation.
+		 */
+		if (desc->op == PADLOCK_CMD_AUTH_MAC) {
+			if (off != CMD_TLV_HDR_LEN) {
+				goto invalid;
+			}
+			mac = &buf[off + 2];
+			off += 2 + op_len;
+			continue;
+		}
+
+		if ((desc->op == PADLOCK_CMD_AUTH) &&
+		    !IS_ENABLED(CONFIG_PADLOCK_AUTH_PLAIN_KEY)) {
+			goto invalid;
+		}
+
+		/* The new key is encrypted under the nonce of the MAC. */
+		if ((desc->op == PADLOCK_CMD_KEY_UPDATE) && !mac) {
+			goto invalid;
+		}
+
+		cmd = &batch.cmds[batch.count++];
+		cmd->op = desc->op;
+		cmd->flags = 0;
+		cmd->len = op_len;
+		memcpy(cmd->data, &buf[off + 2], op_len);
+		off += 2 + op_len;
+	}
+
+	if (batch.count == 0) {
+		goto invalid;
+	}
+
+	if (mac) {
+		if (!cmd_mac_verify(buf, len, mac, pad)) {
+			stats.auth_failed++;
+			audit_log(AUDIT_EVT_AUTH_FAIL, AUDIT_SRC_BLE,
+				  AUDIT_USER_NONE, 0);
+			cmd_reject(batch.seq, PADLOCK_CMD_STATUS_AUTH_FAILED);
+			return -EACCES;
+		}
+
+		/* Verified here, the worker only runs what follows. */
+		batch.preauth = true;
+
+		for (uint8_t i = 0; i < batch.count; i++) {
+			struct padlock_cmd *cmd = &batch.cmds[i];
+
+			if (cmd->op != PADLOCK_CMD_KEY_UPDATE) {
+				continue;
+			}
+			for (uint8_t j = 0; j < cmd->len; j++) {
+				cmd->data[j] ^= pad[j];
+			}
+		}
+		memset(pad, 0, sizeof(pad));
+	}
+
+	return cmd_batch_queue(&batch);
+
+invalid:
+	stats.invalid++;
+	cmd_reject(batch.seq, PADLOCK_CMD_STATUS_INVALID);
+	return -EINVAL;
+}
+
+void padlock_cmd_get_stats(struct padlock_cmd_stats *out)
+{
+	*out = stats;
+}
+
+static padlock_cmd_handler_t cmd_handler_find(uint8_t op)
+{
+	for (size_t i = 0; i < cmd_handler_count; i++) {
+		if (cmd_handlers[i].op == op) {
+			return cmd_handlers[i].handler;
+		}
+	}
+
+	return NULL;
+}
+
+static enum padlock_cmd_status cmd_execute(const struct padlock_cmd *cmd,
+					   uint16_t *user,
+					   struct net_buf_simple *rsp)
+{
+	const struct cmd_op_desc *desc = cmd_op_find(cmd->op);
+	padlock_cmd_handler_t handler = cmd_handler_find(cmd->op);
+
+	if (!desc || !handler) {
+		return PADLOCK_CMD_STATUS_NOT_ALLOWED;
+	}
+
+	if ((desc->auth == CMD_AUTH_USER && *user == AUDIT_USER_NONE) ||
+	    (desc->auth == CMD_AUTH_MASTER && *user != AUDIT_USER_MASTER)) {
+		return PADLOCK_CMD_STATUS_AUTH_FAILED;
+	}
+
+	return handler(cmd, user, rsp);
+}
+
+static void cmd_thread_fn(void)
+{
+	NET_BUF_SIMPLE_DEFINE(result, CMD_RESULT_MAX_LEN);
+	NET_BUF_SIMPLE_DEFINE(rsp, sizeof(uint32_t));
+	struct cmd_batch batch;
+	enum padlock_cmd_status status;
+	uint16_t user;
+	uint32_t latency;
+
+	for (;;) {
+		k_msgq_get(&cmd_msgq, &batch, K_FOREVER);
+
+		net_buf_simple_reset(&result);
+		net_buf_simple_add_u8(&result, batch.seq);
+		user = batch.preauth ? AUDIT_USER_MASTER : AUDIT_USER_NONE;
+
+		for (uint8_t i = 0; i < batch.count; i++) {
+			const struct padlock_cmd *cmd = &batch.cmds[i];
+
+			net_buf_simple_reset(&rsp);
+			status = cmd_execute(cmd, &user, &rsp);
+
+			if (cmd->op == PADLOCK_CMD_AUTH &&
+			    status != PADLOCK_CMD_STATUS_OK) {
+				user = AUDIT_USER_NONE;
+			}
+
+			stats.completed++;
+			if (status != PADLOCK_CMD_STATUS_OK) {
+				stats.failed++;
+			}
+
+			if ((cmd->flags & PADLOCK_CMD_F_SILENT) &&
+			    (status == PADLOCK_CMD_STATUS_OK)) {
+				continue;
+			}
+
+			if (net_buf_simple_tailroom(&result) >= (2 + rsp.len)) {
+				net_buf_simple_add_u8(&result, cmd->op);
+				net_buf_simple_add_u8(&result, status);
+				net_buf_simple_add_mem(&result, rsp.data, rsp.len);
+			}
+		}
+
+		latency = k_uptime_get_32() - batch.submit_time;
+		stats.latency_total_ms += latency;
+		stats.latency_max_ms = MAX(stats.latency_max_ms, latency);
+
+		(void)bt_padlock_send_result(result.data, result.len);
+	}
+}
+
+K_THREAD_DEFINE(cmd_thread, CONFIG_PADLOCK_CMD_STACK_SIZE, cmd_thread_fn,
+		NULL, NULL, NULL, CONFIG_PADLOCK_CMD_THREAD_PRIO, 0, 0);
@@ -0,0 +1,199 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CMD_H_
+#define CMD_H_
+
+/**@file
+ * @defgroup padlock_cmd Padlock command pipeline
+ * @{
+ * @brief Bounded queue of typed commands between GATT and the lock.
+ *
+ * The GATT write handlers validate a PDU and enqueue all of its
+ * operations as one batch. A dedicated worker thread executes queued
+ * batches in order and notifies one completion result per batch.
+ *
+ * Two PDU formats are accepted:
+ *
+ * - The legacy 8 byte key frame: 0x55, 6 byte payload, opcode trailer.
+ *   Only with CONFIG_PADLOCK_AUTH_PLAIN_KEY, and not for
+ *   PADLOCK_CMD_KEY_UPDATE.
+ * - The TLV command PDU: version, sequence number, then one or more
+ *   operations encoded as type, length, value. The type is the opcode.
+ *
+ * A TLV PDU may start with PADLOCK_CMD_AUTH_MAC, see auth.h. The MAC is
+ * checked before the batch is queued and covers the version, the
+ * sequence number and all following operations. A PDU with a wrong MAC
+ * is rejected with PADLOCK_CMD_STATUS_AUTH_FAILED and none of its
+ * operations run.
+ *
+ * PADLOCK_CMD_KEY_UPDATE is only accepted in a PDU with a MAC. Its value
+ * is the new key XORed with the first bytes of E(key, nonce) under the
+ * current key, see auth_verify_pad().
+ *
+ * Operations that change the key, the clock or the credentials need the
+ * master key, either through PADLOCK_CMD_AUTH or the MAC. A credential
+ * key only authorizes opening, closing and the auto close setting.
+ *
+ * The completion result is the sequence number followed by opcode and
+ * status for each operation. PADLOCK_CMD_READ_STATUS is followed by the
+ * 4 byte little endian device status, PADLOCK_CMD_CRED_REVOKE by the
+ * number of credentials revoked.
+ */
+
+#include <zephyr/types.h>
+#include <zephyr/net/buf.h>
+
+/** @brief Version byte of the TLV command PDU. */
+#define PADLOCK_TLV_VERSION	0x01
+
+/** @brief Command opcodes, also used as TLV types. */
+enum padlock_cmd_op {
+	/** Authenticate the following operations of the batch. */
+	PADLOCK_CMD_AUTH        = 0x01,
+	/** Authenticate the PDU with a MAC over the session nonce. */
+	PADLOCK_CMD_AUTH_MAC    = 0x02,
+	/** Open the shackle. */
+	PADLOCK_CMD_UNLOCK      = 0xAA,
+	/** Close the shackle. */
+	PADLOCK_CMD_LOCK        = 0xAB,
+	/** Replace the key. */
+	PADLOCK_CMD_KEY_UPDATE  = 0xBB,
+	/** Change the auto close setting. */
+	PADLOCK_CMD_AUTO_CLOSE  = 0xCC,
+	/** Read the device status. */
+	PADLOCK_CMD_READ_STATUS = 0xDD,
+	/** Revoke all credentials of a user, LE16 user id. */
+	PADLOCK_CMD_CRED_REVOKE = 0x10,
+	/** Set the credential clock, LE32 seconds. */
+	PADLOCK_CMD_CLOCK_SET   = 0x11,
+};
+
+/** @brief Command completion status, notified back to the client. */
+enum padlock_cmd_status {
+	PADLOCK_CMD_STATUS_OK,
+	/** The key did not match, or the operation was not authenticated
+	 *  with a key allowed to run it.
+	 */
+	PADLOCK_CMD_STATUS_AUTH_FAILED,
+	/** The command is not allowed in the current configuration. */
+	PADLOCK_CMD_STATUS_NOT_ALLOWED,
+	/** The motor is already running. */
+	PADLOCK_CMD_STATUS_BUSY,
+	/** Writing to flash failed. */
+	PADLOCK_CMD_STATUS_STORAGE_ERROR,
+	/** The motor ran for its maximum time without reaching position. */
+	PADLOCK_CMD_STATUS_MOTOR_TIMEOUT,
+	/** The lock controller did not complete the command in time. */
+	PADLOCK_CMD_STATUS_TIMEOUT,
+	/** The PDU was malformed and none of its operations were run. */
+	PADLOCK_CMD_STATUS_INVALID,
+	/** The queue was full and none of the operations were run. */
+	PADLOCK_CMD_STATUS_QUEUE_FULL,
+	/** The credential store has no room for the records. */
+	PADLOCK_CMD_STATUS_NO_SPACE,
+};
+
+/** Do not report the operation in the batch result. */
+#define PADLOCK_CMD_F_SILENT	BIT(0)
+
+/** @brief One operation of a batch. */
+struct padlock_cmd {
+	/** One of #padlock_cmd_op. */
+	uint8_t op;
+	/** PADLOCK_CMD_F_* flags. */
+	uint8_t flags;
+	/** Length of @ref data. */
+	uint8_t len;
+	/** Operation payload. */
+	uint8_t data[6];
+};
+
+/** @brief Handler executing one kind of operation in the worker thread.
+ *
+ * @param cmd Operation to execute.
+ * @param user Authenticated user of the batch, or AUDIT_USER_NONE. The
+ *             PADLOCK_CMD_AUTH handler sets it on success.
+ * @param rsp Buffer for an optional response value.
+ *
+ * @return Completion status of the operation.
+ */
+typedef enum padlock_cmd_status (*padlock_cmd_handler_t)(
+	const struct padlock_cmd *cmd, uint16_t *user,
+	struct net_buf_simple *rsp);
+
+/** @brief Entry of the application's operation handler table. */
+struct padlock_cmd_handler {
+	/** One of #padlock_cmd_op. */
+	uint8_t op;
+	/** Handler for the operation. */
+	padlock_cmd_handler_t handler;
+};
+
+/** @brief Command pipeline statistics. */
+struct padlock_cmd_stats {
+	/** Batches accepted into the queue. */
+	uint32_t submitted;
+	/** PDUs rejected because they were malformed. */
+	uint32_t invalid;
+	/** Batches rejected because the queue was full. */
+	uint32_t rejected;
+	/** PDUs rejected because their MAC did not verify. */
+	uint32_t auth_failed;
+	/** Operations executed. */
+	uint32_t completed;
+	/** Executed operations that did not return PADLOCK_CMD_STATUS_OK. */
+	uint32_t failed;
+	/** Sum of queue-to-completion latencies of batches, in milliseconds. */
+	uint32_t latency_total_ms;
+	/** Worst queue-to-completion latency of a batch, in milliseconds. */
+	uint32_t latency_max_ms;
+};
+
+/** @brief Set the table of operation handlers.
+ *
+ * @param handlers Handler table, must stay valid.
+ * @param count Number of entries in @p handlers.
+ */
+void padlock_cmd_init(const struct padlock_cmd_handler *handlers,
+		      size_t count);
+
+/** @brief Validate a legacy key frame and queue its command.
+ *
+ * @param buf Frame written by the client.
+ * @param len Length of the frame.
+ *
+ * @retval 0 If the command was queued.
+ * @retval -EINVAL If the frame is not a valid command.
+ * @retval -ENOMEM If the queue is full.
+ */
+int padlock_cmd_submit_frame(const uint8_t *buf, uint16_t len);
+
+/** @brief Validate a TLV command PDU and queue all of its operations.
+ *
+ * Either every operation of the PDU is queued, or none is.
+ *
+ * @param buf PDU written by the client.
+ * @param len Length of the PDU.
+ *
+ * @retval 0 If the batch was queued.
+ * @retval -EINVAL If the PDU is malformed.
+ * @retval -EACCES If the PDU MAC did not verify.
+ * @retval -ENOMEM If the queue is full.
+ */
+int padlock_cmd_submit_tlv(const uint8_t *buf, uint16_t len);
+
+/** @brief Get a snapshot of the pipeline statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void padlock_cmd_get_stats(struct padlock_cmd_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* CMD_H_ */
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+
+#include "conn_policy.h"
+
+static const struct bt_le_conn_param fast_param = BT_LE_CONN_PARAM_INIT(
+	CONFIG_PADLOCK_CONN_FAST_INTERVAL_MIN,
+	CONFIG_PADLOCK_CONN_FAST_INTERVAL_MAX,
+	0,
+	CONFIG_PADLOCK_CONN_FAST_TIMEOUT);
+
+static const struct bt_le_conn_param idle_param = BT_LE_CONN_PARAM_INIT(
+	CONFIG_PADLOCK_CONN_IDLE_INTERVAL_MIN,
+	CONFIG_PADLOCK_CONN_IDLE_INTERVAL_MAX,
+	CONFIG_PADLOCK_CONN_IDLE_LATENCY,
+	CONFIG_PADLOCK_CONN_IDLE_TIMEOUT);
+
+BUILD_ASSERT((CONFIG_PADLOCK_CONN_IDLE_TIMEOUT * 10) >
+	     ((1 + CONFIG_PADLOCK_CONN_IDLE_LATENCY) *
+	      CONFIG_PADLOCK_CONN_IDLE_INTERVAL_MAX * 5 / 4 * 2),
+	     "Idle supervision timeout too short for the idle latency");
+
+static struct bt_conn *current_conn;
+static atomic_t profile;
+static struct conn_policy_stats stats;
+
+static void profile_request(enum conn_policy_profile next)
+{
+	const struct bt_le_conn_param *param;
+	int err;
+
+	if (!current_conn) {
+		return;
+	}
+
+	param = (next == CONN_POLICY_FAST) ? &fast_param : &idle_param;
+
+	err = bt_conn_le_param_update(current_conn, param);
+	if (err) {
+		stats.request_errors++;
+		return;
+	}
+
+	if (next == CONN_POLICY_FAST) {
+		stats.fast_requests++;
+	} else {
+		stats.idle_requests++;
+	}
+}
+
+static void fast_work_fn(struct k_work *work)
+{
+	profile_request(CONN_POLICY_FAST);
+}
+
+static void idle_work_fn(struct k_work *work)
+{
+	if (atomic_cas(&profile, CONN_POLICY_FAST, CONN_POLICY_IDLE)) {
+		profile_request(CONN_POLICY_IDLE);
+	}
+}
+
+static K_WORK_DEFINE(fast_work, fast_work_fn);
+static K_WORK_DELAYABLE_DEFINE(idle_work, idle_work_fn);
+
+static void link_upgrade(struct bt_conn *conn)
+{
+	int err;
+
+	if (IS_ENABLED(CONFIG_BT_USER_PHY_UPDATE)) {
+		err = bt_conn_le_phy_update(conn, BT_CONN_LE_PHY_PARAM_2M);
+		if (err) {
+			printk("PHY update request failed (err %d)\n", err);
+		}
+	}
+
+	if (IS_ENABLED(CONFIG_BT_USER_DATA_LEN_UPDATE)) {
+		err = bt_conn_le_data_len_update(conn, BT_LE_DATA_LEN_PARAM_MAX);
+		if (err) {
+			printk("Data length update request failed (err %d)\n",
+			       err);
+		}
+	}
+}
+
+static void connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err || current_conn) {
+		return;
+	}
+
+	current_conn = bt_conn_ref(conn);
+
+	link_upgrade(conn);
+
+	atomic_set(&profile, CONN_POLICY_FAST);
+	k_work_submit(&fast_work);
+	k_work_reschedule(&idle_work, K_MSEC(CONFIG_PADLOCK_CONN_IDLE_TIMEOUT_MS));
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	if (conn != current_conn) {
+		return;
+	}
+
+	atomic_set(&profile, CONN_POLICY_NONE);
+	(void)k_work_cancel_delayable(&idle_work);
+	(void)k_work_cancel(&fast_work);
+
+	bt_conn_unref(current_conn);
+	current_conn = NULL;
+}
+
+static void le_param_updated(struct bt_conn *conn, uint16_t interval,
+			     uint16_t latency, uint16_t timeout)
+{
+	stats.interval = interval;
+	stats.latency = latency;
+	stats.timeout = timeout;
+}
+
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+static void le_phy_updated(struct bt_conn *conn,
+			   struct bt_conn_le_phy_info *param)
+{
+	stats.tx_phy = param->tx_phy;
+}
+#endif
+
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+static void le_data_len_updated(struct bt_conn *conn,
+				struct bt_conn_le_data_len_info *info)
+{
+	stats.tx_max_len = info->tx_max_len;
+}
+#endif
+
+BT_CONN_CB_DEFINE(conn_policy_callbacks) = {
+	.connected           = connected,
+	.disconnected        = disconnected,
+	.le_param_updated    = le_param_updated,
+#if defined(CONFIG_BT_USER_PHY_UPDATE)
+	.le_phy_updated      = le_phy_updated,
+#endif
+#if defined(CONFIG_BT_USER_DATA_LEN_UPDATE)
+	.le_data_len_updated = le_data_len_updated,
+#endif
+};
+
+void conn_policy_activity(void)
+{
+	if (atomic_get(&profile) == CONN_POLICY_NONE) {
+		return;
+	}
+
+	if (atomic_set(&profile, CONN_POLICY_FAST) == CONN_POLICY_IDLE) {
+		k_work_submit(&fast_work);
+	}
+
+	k_work_reschedule(&idle_work, K_MSEC(CONFIG_PADLOCK_CONN_IDLE_TIMEOUT_MS));
+}
+
+enum conn_policy_profile conn_policy_get_profile(void)
+{
+	return atomic_get(&profile);
+}
+
+void conn_policy_get_stats(struct conn_policy_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CONN_POLICY_H_
+#define CONN_POLICY_H_
+
+/**@file
+ * @defgroup conn_policy Connection parameter policy
+ * @{
+ * @brief Switches the link between a fast and a low power profile.
+ *
+ * Right after connecting, and whenever a command arrives, the central is
+ * asked for the fast profile: a short connection interval without
+ * peripheral latency. Once the link has been idle for
+ * CONFIG_PADLOCK_CONN_IDLE_TIMEOUT_MS it is moved to the idle profile: a
+ * long interval with high peripheral latency, so the radio only wakes up
+ * for the occasional connection event.
+ *
+ * On connect the 2M PHY and the maximum data length are also requested.
+ * Centrals that do not support them keep the defaults.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Connection profile. */
+enum conn_policy_profile {
+	/** No connection. */
+	CONN_POLICY_NONE,
+	/** Short interval, no peripheral latency. */
+	CONN_POLICY_FAST,
+	/** Long interval, high peripheral latency. */
+	CONN_POLICY_IDLE,
+};
+
+/** @brief Connection policy statistics. */
+struct conn_policy_stats {
+	/** Fast profile requests sent to the central. */
+	uint32_t fast_requests;
+	/** Idle profile requests sent to the central. */
+	uint32_t idle_requests;
+	/** Parameter update requests that could not be sent. */
+	uint32_t request_errors;
+	/** Connection interval in use, in 1.25 ms units. */
+	uint16_t interval;
+	/** Peripheral latency in use, in connection events. */
+	uint16_t latency;
+	/** Supervision timeout in use, in 10 ms units. */
+	uint16_t timeout;
+	/** Transmit PHY in use, BT_GAP_LE_PHY_*. */
+	uint8_t tx_phy;
+	/** Maximum transmit data length in use, in octets. */
+	uint16_t tx_max_len;
+};
+
+/** @brief Report command activity on the link.
+ *
+ * Moves the link to the fast profile if it is idle and restarts the idle
+ * timeout. Safe to call from the Bluetooth receive thread.
+ */
+void conn_policy_activity(void);
+
+/** @brief Get the profile the link was last moved to. */
+enum conn_policy_profile conn_policy_get_profile(void);
+
+/** @brief Get a snapshot of the connection policy statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void conn_policy_get_stats(struct conn_policy_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* CONN_POLICY_H_ */
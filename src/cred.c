@@ -0,0 +1,325 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <string.h>
+
+#include "cred.h"
+#include "storage.h"
+
+#define CRED_INDEX_SIZE		CONFIG_PADLOCK_CRED_INDEX_SIZE
+#define CRED_INDEX_MASK		(CRED_INDEX_SIZE - 1)
+
+BUILD_ASSERT((CRED_INDEX_SIZE & CRED_INDEX_MASK) == 0,
+	     "Credential index size must be a power of two");
+BUILD_ASSERT(CRED_INDEX_SIZE >= (2 * CONFIG_PADLOCK_CRED_MAX),
+	     "Credential index must be at most half full");
+BUILD_ASSERT(CONFIG_PADLOCK_CRED_MAX < 0xFFFE,
+	     "Credential slots must fit the index entries");
+
+/* Index entry states, other values are slot numbers. */
+#define CRED_SLOT_EMPTY		0xFFFF
+#define CRED_SLOT_DELETED	0xFFFE
+
+struct cred_index_entry {
+	uint16_t slot;
+	/* High bits of the hash, filters out most non-matching slots. */
+	uint16_t tag;
+};
+
+static struct cred_index_entry cred_index[CRED_INDEX_SIZE];
+static ATOMIC_DEFINE(slot_used, CONFIG_PADLOCK_CRED_MAX);
+static uint16_t slot_user[CONFIG_PADLOCK_CRED_MAX];
+static size_t used_count;
+static int64_t clock_offset;
+/* The clock restarts from zero on every reset, System OFF wake included,
+ * and is only trusted once a client has set it again.
+ */
+static bool clock_set;
+
+static K_MUTEX_DEFINE(cred_lock);
+
+/* FNV-1a over type and secret. */
+static uint32_t cred_hash(uint8_t type, const uint8_t *secret, size_t len)
+{
+	uint32_t hash = 2166136261U;
+
+	hash = (hash ^ type) * 16777619U;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ secret[i]) * 16777619U;
+	}
+
+	return hash;
+}
+
+static int slot_read(uint16_t slot, struct cred_record *rec)
+{
+	ssize_t rc = storage_read(STORAGE_ID_CRED_BASE + slot, rec,
+				  sizeof(*rec));
+
+	return (rc == sizeof(*rec)) ? 0 : -ENOENT;
+}
+
+bool cred_record_valid(const struct cred_record *rec)
+{
+	return ((rec->type == CRED_TYPE_PIN) ||
+		(rec->type == CRED_TYPE_BLE_KEY)) &&
+	       (rec->len > 0) && (rec->len <= CRED_SECRET_MAX);
+}
+
+static void index_insert(uint16_t slot, uint32_t hash)
+{
+	uint32_t pos = hash & CRED_INDEX_MASK;
+
+	while ((cred_index[pos].slot != CRED_SLOT_EMPTY) &&
+	       (cred_index[pos].slot != CRED_SLOT_DELETED)) {
+		pos = (pos + 1) & CRED_INDEX_MASK;
+	}
+
+	cred_index[pos].slot = slot;
+	cred_index[pos].tag = hash >> 16;
+}
+
+static void index_remove(uint16_t slot, uint32_t hash)
+{
+	uint32_t pos = hash & CRED_INDEX_MASK;
+
+	for (size_t n = 0; n < CRED_INDEX_SIZE; n++) {
+		if (cred_index[pos].slot == CRED_SLOT_EMPTY) {
+			return;
+		}
+		if (cred_index[pos].slot == slot) {
+			cred_index[pos].slot = CRED_SLOT_DELETED;
+			return;
+		}
+		pos = (pos + 1) & CRED_INDEX_MASK;
+	}
+}
+
+/* Slot of the credential with this type and secret, or a negative error. */
+static int index_find(uint8_t type, const uint8_t *secret, size_t len,
+		      struct cred_record *rec)
+{
+	uint32_t hash = cred_hash(type, secret, len);
+	uint32_t pos = hash & CRED_INDEX_MASK;
+
+	for (size_t n = 0; n < CRED_INDEX_SIZE; n++) {
+		struct cred_index_entry *e = &cred_index[pos];
+
+		if (e->slot == CRED_SLOT_EMPTY) {
+			break;
+		}
+
+		if ((e->slot != CRED_SLOT_DELETED) && (e->tag == (hash >> 16)) &&
+		    !slot_read(e->slot, rec) && (rec->type == type) &&
+		    (rec->len == len) &&
+		    cred_secret_equal(rec->secret, secret, len)) {
+			return e->slot;
+		}
+
+		pos = (pos + 1) & CRED_INDEX_MASK;
+	}
+
+	return -ENOENT;
+}
+
+bool cred_secret_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+	uint8_t diff = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		diff |= a[i] ^ b[i];
+	}
+
+	return diff == 0;
+}
+
+int cred_init(void)
+{
+	struct cred_record rec;
+
+	k_mutex_lock(&cred_lock, K_FOREVER);
+
+	for (size_t i = 0; i < ARRAY_SIZE(cred_index); i++) {
+		cred_index[i].slot = CRED_SLOT_EMPTY;
+	}
+	used_count = 0;
+
+	for (uint16_t slot = 0; slot < CONFIG_PADLOCK_CRED_MAX; slot++) {
+		if (slot_read(slot, &rec) || !cred_record_valid(&rec)) {
+			continue;
+		}
+
+		atomic_set_bit(slot_used, slot);
+		slot_user[slot] = rec.user_id;
+		index_insert(slot, cred_hash(rec.type, rec.secret, rec.len));
+		used_count++;
+	}
+
+	k_mutex_unlock(&cred_lock);
+
+	return used_count;
+}
+
+int cred_add(const struct cred_record *rec)
+{
+	struct cred_record found;
+	uint16_t slot;
+	ssize_t rc;
+
+	if (!cred_record_valid(rec)) {
+		return -EINVAL;
+	}
+
+	k_mutex_lock(&cred_lock, K_FOREVER);
+
+	if (index_find(rec->type, rec->secret, rec->len, &found) >= 0) {
+		k_mutex_unlock(&cred_lock);
+		return -EEXIST;
+	}
+
+	for (slot = 0; slot < CONFIG_PADLOCK_CRED_MAX; slot++) {
+		if (!atomic_test_bit(slot_used, slot)) {
+			break;
+		}
+	}
+
+	if (slot == CONFIG_PADLOCK_CRED_MAX) {
+		k_mutex_unlock(&cred_lock);
+		return -ENOSPC;
+	}
+
+	rc = storage_write(STORAGE_ID_CRED_BASE + slot, rec, sizeof(*rec));
+	if (rc < 0) {
+		k_mutex_unlock(&cred_lock);
+		return rc;
+	}
+
+	atomic_set_bit(slot_used, slot);
+	slot_user[slot] = rec->user_id;
+	index_insert(slot, cred_hash(rec->type, rec->secret, rec->len));
+	used_count++;
+
+	k_mutex_unlock(&cred_lock);
+
+	return 0;
+}
+
+int cred_revoke_user(uint16_t user_id)
+{
+	struct cred_record rec;
+	int revoked = 0;
+	int err;
+
+	k_mutex_lock(&cred_lock, K_FOREVER);
+
+	for (uint16_t slot = 0; slot < CONFIG_PADLOCK_CRED_MAX; slot++) {
+		if (!atomic_test_bit(slot_used, slot) ||
+		    (slot_user[slot] != user_id)) {
+			continue;
+		}
+
+		err = slot_read(slot, &rec);
+		if (!err) {
+			err = storage_delete(STORAGE_ID_CRED_BASE + slot);
+		}
+		if (err) {
+			k_mutex_unlock(&cred_lock);
+			return err;
+		}
+
+		index_remove(slot, cred_hash(rec.type, rec.secret, rec.len));
+		atomic_clear_bit(slot_used, slot);
+		used_count--;
+		revoked++;
+	}
+
+	k_mutex_unlock(&cred_lock);
+
+	return revoked;
+}
+
+int cred_clear(void)
+{
+	int err;
+
+	k_mutex_lock(&cred_lock, K_FOREVER);
+
+	for (uint16_t slot = 0; slot < CONFIG_PADLOCK_CRED_MAX; slot++) {
+		if (!atomic_test_bit(slot_used, slot)) {
+			continue;
+		}
+
+		err = storage_delete(STORAGE_ID_CRED_BASE + slot);
+		if (err) {
+			k_mutex_unlock(&cred_lock);
+			return err;
+		}
+
+		atomic_clear_bit(slot_used, slot);
+		used_count--;
+	}
+
+	for (size_t i = 0; i < ARRAY_SIZE(cred_index); i++) {
+		cred_index[i].slot = CRED_SLOT_EMPTY;
+	}
+
+	k_mutex_unlock(&cred_lock);
+
+	return 0;
+}
+
+uint32_t cred_clock_get(void)
+{
+	return (k_uptime_get() / MSEC_PER_SEC) + clock_offset;
+}
+
+int cred_lookup(uint8_t type, const uint8_t *secret, size_t len,
+		uint16_t *user_id)
+{
+	struct cred_record rec;
+	int slot;
+
+	if ((len == 0) || (len > CRED_SECRET_MAX)) {
+		return -ENOENT;
+	}
+
+	k_mutex_lock(&cred_lock, K_FOREVER);
+	slot = index_find(type, secret, len, &rec);
+	k_mutex_unlock(&cred_lock);
+
+	if (slot < 0) {
+		return -ENOENT;
+	}
+
+	if (rec.expires) {
+		if (!clock_set) {
+			return -EAGAIN;
+		}
+		if (cred_clock_get() >= rec.expires) {
+			return -ETIMEDOUT;
+		}
+	}
+
+	if (user_id) {
+		*user_id = rec.user_id;
+	}
+
+	return 0;
+}
+
+void cred_clock_set(uint32_t now)
+{
+	clock_offset = (int64_t)now - (k_uptime_get() / MSEC_PER_SEC);
+	clock_set = true;
+}
+
+size_t cred_count(void)
+{
+	return used_count;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef CRED_H_
+#define CRED_H_
+
+/**@file
+ * @defgroup cred Credential store
+ * @{
+ * @brief Keypad PINs and BLE keys, persisted one record per NVS entry.
+ *
+ * Each credential lives in its own slot, so adding or revoking one never
+ * rewrites the others. A RAM hash index keyed on type and secret keeps
+ * lookup cost flat as the table grows: a lookup hashes the secret, probes
+ * the index and reads a single record back to compare it in constant
+ * time.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Maximum length of a credential secret. */
+#define CRED_SECRET_MAX		8
+
+/** @brief Credential type. */
+enum cred_type {
+	/** Keypad PIN, one byte per key. */
+	CRED_TYPE_PIN = 1,
+	/** BLE key. */
+	CRED_TYPE_BLE_KEY,
+};
+
+/** @brief Persistent credential record. */
+struct cred_record {
+	/** One of #cred_type. */
+	uint8_t type;
+	/** Length of @ref secret. */
+	uint8_t len;
+	/** Owner of the credential, used to revoke it. */
+	uint16_t user_id;
+	/** Expiry in seconds of the credential clock, 0 for none. */
+	uint32_t expires;
+	/** PIN keys or key bytes. */
+	uint8_t secret[CRED_SECRET_MAX];
+} __packed;
+
+/** @brief Check that a record is well formed.
+ *
+ * @param rec Record to check.
+ *
+ * @return true if cred_add() would accept the record.
+ */
+bool cred_record_valid(const struct cred_record *rec);
+
+/** @brief Load the credentials and build the index.
+ *
+ * Must be called after storage_init().
+ *
+ * @return Number of credentials loaded, or a negative error code.
+ */
+int cred_init(void);
+
+/** @brief Add a credential.
+ *
+ * @param rec Credential to add.
+ *
+ * @retval 0 If the credential was stored.
+ * @retval -EEXIST If a credential with the same type and secret exists.
+ * @retval -ENOSPC If the store is full.
+ * @retval -EINVAL If the record is malformed.
+ */
+int cred_add(const struct cred_record *rec);
+
+/** @brief Revoke every credential of a user.
+ *
+ * @param user_id Owner of the credentials.
+ *
+ * @return Number of credentials revoked, or a negative error code.
+ */
+int cred_revoke_user(uint16_t user_id);
+
+/** @brief Remove all credentials.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int cred_clear(void);
+
+/** @brief Look up a credential.
+ *
+ * @param type One of #cred_type.
+ * @param secret Secret presented by the user.
+ * @param len Length of @p secret.
+ * @param[out] user_id Owner of the matching credential, may be NULL.
+ *
+ * @retval 0 If a valid credential matched.
+ * @retval -ENOENT If no credential matched.
+ * @retval -ETIMEDOUT If the matching credential has expired.
+ * @retval -EAGAIN If the matching credential expires and the clock has
+ *                 not been set since boot.
+ */
+int cred_lookup(uint8_t type, const uint8_t *secret, size_t len,
+		uint16_t *user_id);
+
+/** @brief Set the credential clock.
+ *
+ * Expiry times are compared against this clock, which then advances with
+ * the system uptime. Until it is set after a boot, credentials with an
+ * expiry are rejected.
+ *
+ * @param now Current time in seconds.
+ */
+void cred_clock_set(uint32_t now);
+
+/** @brief Get the credential clock, in seconds. */
+uint32_t cred_clock_get(void);
+
+/** @brief Get the number of stored credentials. */
+size_t cred_count(void);
+
+/** @brief Compare two secrets in constant time.
+ *
+ * @retval true If the first @p len bytes are equal.
+ */
+bool cred_secret_equal(const uint8_t *a, const uint8_t *b, size_t len);
+
+/**
+ * @}
+ */
+
+#endif /* CRED_H_ */
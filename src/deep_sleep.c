@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <hal/nrf_power.h>
+#include <string.h>
+
+#include "deep_sleep.h"
+#include "audit.h"
+#include "led_buttons.h"
+#include "lock_ctrl.h"
+#include "padlock_cfg.h"
+#include "storage.h"
+
+#define RETAINED_MAGIC		0x534c5031
+
+/* nRF52 RAM blocks are made of 4 KiB sections, two per block. */
+#define RAM_SECTION_SIZE	0x1000
+#define RAM_BLOCK_SECTIONS	2
+#define RAM_BASE		0x20000000
+
+/* Retry interval while the motor is running or USB power is present. */
+#define SLEEP_RETRY_MS		(10 * MSEC_PER_SEC)
+
+struct retained {
+	uint32_t magic;
+	uint32_t off_count;
+	uint8_t lock_state;
+	uint8_t motor_fault;
+	struct lock_ctrl_stats lock_stats;
+	uint32_t crc;
+};
+
+/* Survives System OFF as long as its RAM sections are retained. */
+static __noinit struct retained retained;
+
+static struct deep_sleep_stats stats;
+static bool woke;
+static bool connected;
+
+static void sleep_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(sleep_work, sleep_work_fn);
+
+static uint32_t retained_crc(void)
+{
+	return crc32_ieee((const uint8_t *)&retained,
+			  offsetof(struct retained, crc));
+}
+
+static void ram_retain(const void *ptr, size_t len)
+{
+	uintptr_t start = ROUND_DOWN((uintptr_t)ptr - RAM_BASE,
+				     RAM_SECTION_SIZE);
+	uintptr_t end = (uintptr_t)ptr - RAM_BASE + len;
+
+	for (uintptr_t off = start; off < end; off += RAM_SECTION_SIZE) {
+		uint32_t section = off / RAM_SECTION_SIZE;
+
+		nrf_power_rampower_mask_on(NRF_POWER,
+			section / RAM_BLOCK_SECTIONS,
+			NRF_POWER_RAMPOWER_S0RETENTION_MASK <<
+			(section % RAM_BLOCK_SECTIONS));
+	}
+}
+
+static bool sleep_allowed(void)
+{
+	enum lock_state state = lock_ctrl_get_state();
+
+	return !connected && !lock_ctrl_usb_detect() &&
+	       ((state == LOCK_STATE_LOCKED) || (state == LOCK_STATE_OPEN));
+}
+
+static void system_off(void)
+{
+	retained.magic = RETAINED_MAGIC;
+	retained.off_count++;
+	retained.lock_state = lock_ctrl_get_state();
+	retained.motor_fault = lock_ctrl_motor_fault();
+	lock_ctrl_get_stats(&retained.lock_stats);
+	retained.crc = retained_crc();
+
+	/* Nothing written after this point survives. The writes run on the
+	 * storage work queue, this one has too little stack for NVS.
+	 */
+	padlock_cfg_flush();
+	audit_flush();
+	storage_work_drain();
+
+	user_set_led_all_off();
+	user_buttons_wake_enable();
+	ram_retain(&retained, sizeof(retained));
+
+	printk("Entering System OFF\n");
+
+	nrf_power_system_off(NRF_POWER);
+
+	/* System OFF is entered before this is reached. */
+	for (;;) {
+		k_cpu_idle();
+	}
+}
+
+static void sleep_work_fn(struct k_work *work)
+{
+	if (!sleep_allowed()) {
+		if (!connected) {
+			k_work_schedule(&sleep_work, K_MSEC(SLEEP_RETRY_MS));
+		}
+		return;
+	}
+
+	system_off();
+}
+
+bool deep_sleep_init(void)
+{
+	bool valid = (retained.magic == RETAINED_MAGIC) &&
+		     (retained.crc == retained_crc());
+
+	if (!valid) {
+		memset(&retained, 0, sizeof(retained));
+		return false;
+	}
+
+	woke = true;
+	stats.off_count = retained.off_count;
+	lock_ctrl_restore(retained.lock_state, retained.motor_fault,
+			  &retained.lock_stats);
+
+	/* A later reset must not restore the same state again. */
+	retained.magic = 0;
+
+	return true;
+}
+
+void deep_sleep_ready(void)
+{
+	if (woke) {
+		stats.wake_to_adv_ms = k_uptime_get_32();
+	}
+
+	deep_sleep_activity();
+}
+
+void deep_sleep_activity(void)
+{
+	if ((CONFIG_PADLOCK_SLEEP_TIMEOUT_S == 0) || connected) {
+		return;
+	}
+
+	k_work_reschedule(&sleep_work,
+			  K_SECONDS(CONFIG_PADLOCK_SLEEP_TIMEOUT_S));
+}
+
+void deep_sleep_get_stats(struct deep_sleep_stats *out)
+{
+	*out = stats;
+}
+
+static void on_connected(struct bt_conn *conn, uint8_t err)
+{
+	if (err) {
+		return;
+	}
+
+	connected = true;
+	k_work_cancel_delayable(&sleep_work);
+}
+
+static void on_disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	connected = false;
+	deep_sleep_activity();
+}
+
+BT_CONN_CB_DEFINE(deep_sleep_conn_callbacks) = {
+	.connected = on_connected,
+	.disconnected = on_disconnected,
+};
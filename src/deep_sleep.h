@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef DEEP_SLEEP_H_
+#define DEEP_SLEEP_H_
+
+/**@file
+ * @defgroup deep_sleep Deep sleep
+ * @{
+ * @brief System OFF after a period without activity.
+ *
+ * Once nothing has happened for CONFIG_PADLOCK_SLEEP_TIMEOUT_S, no central
+ * is connected, USB power is absent and the motor is idle, pending flash
+ * writes are completed and the SoC enters System OFF. A keypad button, a
+ * lock detect change or USB power wakes it up again through a reset.
+ *
+ * The lock state and the controller counters are kept in retained RAM,
+ * so an open lock still relocks after waking up.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Deep sleep statistics. */
+struct deep_sleep_stats {
+	/** Times the lock entered System OFF, kept across sleeps. */
+	uint32_t off_count;
+	/** Time from the wake up reset to advertising, in milliseconds,
+	 *  0 if the lock did not wake up from System OFF.
+	 */
+	uint32_t wake_to_adv_ms;
+};
+
+/** @brief Restore the retained state.
+ *
+ * Must be called before lock_ctrl_init(), and lock_ctrl_init() must still
+ * be called afterwards.
+ *
+ * @retval true If the lock woke up from System OFF.
+ */
+bool deep_sleep_init(void);
+
+/** @brief Note that the lock is advertising again.
+ *
+ * Starts the inactivity timeout. Called once at the end of start up.
+ */
+void deep_sleep_ready(void);
+
+/** @brief Restart the inactivity timeout. */
+void deep_sleep_activity(void);
+
+/** @brief Get a snapshot of the deep sleep statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void deep_sleep_get_stats(struct deep_sleep_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* DEEP_SLEEP_H_ */
@@ -0,0 +1,344 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/l2cap.h>
+#include <errno.h>
+#include <string.h>
+
+#include "diag.h"
+#include "adv.h"
+#include "audit.h"
+#include "auth.h"
+#include "ble.h"
+#include "cmd.h"
+#include "conn_policy.h"
+#include "deep_sleep.h"
+#include "lock_ctrl.h"
+#include "motor.h"
+#include "padlock_cfg.h"
+#include "prov.h"
+#include "storage.h"
+
+#define DIAG_REQ_HDR_LEN	5
+#define DIAG_REQ_LEN		(DIAG_REQ_HDR_LEN + AUTH_MAC_LEN)
+
+/* Smallest SDU that holds a full audit log block. */
+#define DIAG_SDU_MIN		(2 + sizeof(struct audit_block))
+
+BUILD_ASSERT(CONFIG_PADLOCK_DIAG_MTU >= DIAG_SDU_MIN,
+	     "Diagnostics MTU too small for an audit log block");
+
+NET_BUF_POOL_FIXED_DEFINE(diag_pool, CONFIG_PADLOCK_DIAG_BUF_COUNT,
+			  BT_L2CAP_SDU_BUF_SIZE(CONFIG_PADLOCK_DIAG_MTU),
+			  CONFIG_BT_CONN_TX_USER_DATA_SIZE, NULL);
+
+/* Adds one statistics structure to an SDU. */
+typedef void (*diag_metric_put_t)(struct net_buf *buf);
+
+struct diag_metric_desc {
+	uint8_t id;
+	uint8_t len;
+	diag_metric_put_t put;
+};
+
+/* The SDU offset of a structure is not aligned, so each getter fills an
+ * aligned local of its own type, which is then copied in.
+ */
+#define DIAG_METRIC_PUT(_type, _get)				\
+	static void _get##_put(struct net_buf *buf)		\
+	{							\
+		struct _type s;					\
+								\
+		_get(&s);					\
+		net_buf_add_mem(buf, &s, sizeof(s));		\
+	}
+
+DIAG_METRIC_PUT(lock_ctrl_stats, lock_ctrl_get_stats)
+DIAG_METRIC_PUT(motor_stats, motor_get_stats)
+DIAG_METRIC_PUT(padlock_cmd_stats, padlock_cmd_get_stats)
+DIAG_METRIC_PUT(bt_padlock_notify_stats, bt_padlock_get_notify_stats)
+DIAG_METRIC_PUT(conn_policy_stats, conn_policy_get_stats)
+DIAG_METRIC_PUT(adv_stats, adv_get_stats)
+DIAG_METRIC_PUT(auth_stats, auth_get_stats)
+DIAG_METRIC_PUT(storage_stats, storage_get_stats)
+DIAG_METRIC_PUT(prov_stats, prov_get_stats)
+DIAG_METRIC_PUT(padlock_cfg_stats, padlock_cfg_get_stats)
+DIAG_METRIC_PUT(audit_stats, audit_get_stats)
+DIAG_METRIC_PUT(diag_stats, diag_get_stats)
+DIAG_METRIC_PUT(deep_sleep_stats, deep_sleep_get_stats)
+
+#define DIAG_METRIC(_id, _type, _get) \
+	{ _id, sizeof(struct _type), _get##_put }
+
+static const struct diag_metric_desc metrics[] = {
+	DIAG_METRIC(DIAG_METRIC_LOCK_CTRL, lock_ctrl_stats, lock_ctrl_get_stats),
+	DIAG_METRIC(DIAG_METRIC_MOTOR, motor_stats, motor_get_stats),
+	DIAG_METRIC(DIAG_METRIC_CMD, padlock_cmd_stats, padlock_cmd_get_stats),
+	DIAG_METRIC(DIAG_METRIC_NOTIFY, bt_padlock_notify_stats,
+		    bt_padlock_get_notify_stats),
+	DIAG_METRIC(DIAG_METRIC_CONN, conn_policy_stats, conn_policy_get_stats),
+	DIAG_METRIC(DIAG_METRIC_ADV, adv_stats, adv_get_stats),
+	DIAG_METRIC(DIAG_METRIC_AUTH, auth_stats, auth_get_stats),
+	DIAG_METRIC(DIAG_METRIC_STORAGE, storage_stats, storage_get_stats),
+	DIAG_METRIC(DIAG_METRIC_PROV, prov_stats, prov_get_stats),
+	DIAG_METRIC(DIAG_METRIC_CFG, padlock_cfg_stats, padlock_cfg_get_stats),
+	DIAG_METRIC(DIAG_METRIC_AUDIT, audit_stats, audit_get_stats),
+	DIAG_METRIC(DIAG_METRIC_DIAG, diag_stats, diag_get_stats),
+	DIAG_METRIC(DIAG_METRIC_SLEEP, deep_sleep_stats, deep_sleep_get_stats),
+};
+
+/* Transfer in progress, only touched by the work item once started. */
+struct diag_xfer {
+	uint8_t op;
+	uint8_t status;
+	uint32_t seq;
+	uint32_t end;
+	uint8_t metric;
+	bool done;
+	uint32_t bytes;
+	uint32_t start;
+};
+
+static struct bt_l2cap_le_chan diag_chan;
+static struct diag_xfer xfer;
+static atomic_t active;
+static struct diag_stats stats;
+
+static void diag_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(diag_work, diag_work_handler);
+
+static uint16_t sdu_len(void)
+{
+	return MIN(CONFIG_PADLOCK_DIAG_MTU, diag_chan.tx.mtu);
+}
+
+/* Audit log blocks are read from flash directly into the SDU. */
+static bool fill_log(struct net_buf *buf)
+{
+	while (xfer.seq != xfer.end) {
+		struct audit_block *blk;
+		uint8_t *len;
+		int count;
+
+		if ((sdu_len() - buf->len) < (1 + sizeof(*blk))) {
+			return true;
+		}
+
+		len = net_buf_add(buf, 1);
+		blk = net_buf_tail(buf);
+
+		count = audit_read_block(xfer.seq++, blk);
+		if (count < 0) {
+			net_buf_remove_u8(buf);
+			continue;
+		}
+
+		*len = offsetof(struct audit_block, rec) +
+		       count * sizeof(struct audit_record);
+		net_buf_add(buf, *len);
+	}
+
+	return false;
+}
+
+static bool fill_metrics(struct net_buf *buf)
+{
+	while (xfer.metric < ARRAY_SIZE(metrics)) {
+		const struct diag_metric_desc *m = &metrics[xfer.metric];
+
+		if ((sdu_len() - buf->len) < (2 + m->len)) {
+			return true;
+		}
+
+		net_buf_add_u8(buf, m->id);
+		net_buf_add_u8(buf, m->len);
+		m->put(buf);
+		xfer.metric++;
+	}
+
+	return false;
+}
+
+static void fill_end(struct net_buf *buf)
+{
+	uint32_t ms = MAX(k_uptime_get_32() - xfer.start, 1U);
+
+	stats.last_bytes = xfer.bytes;
+	stats.last_ms = ms;
+	stats.last_bps = (uint64_t)xfer.bytes * MSEC_PER_SEC / ms;
+	if (xfer.status == PADLOCK_CMD_STATUS_OK) {
+		stats.transfers++;
+	} else {
+		stats.errors++;
+	}
+
+	net_buf_add_u8(buf, DIAG_SDU_END);
+	net_buf_add_u8(buf, xfer.status);
+	net_buf_add_le32(buf, stats.last_bytes);
+	net_buf_add_le32(buf, stats.last_ms);
+	net_buf_add_le32(buf, stats.last_bps);
+}
+
+/* Runs on the storage work queue, so flash reads never hold up the
+ * Bluetooth threads. Sends until the buffers run out; the sent callback
+ * resubmits the work as soon as one comes back.
+ */
+static void diag_work_handler(struct k_work *work)
+{
+	while (atomic_get(&active)) {
+		struct net_buf *buf;
+		bool end = false;
+		int err;
+
+		buf = net_buf_alloc(&diag_pool, K_NO_WAIT);
+		if (!buf) {
+			return;
+		}
+		net_buf_reserve(buf, BT_L2CAP_SDU_CHAN_SEND_RESERVE);
+
+		if ((xfer.status == PADLOCK_CMD_STATUS_OK) && !xfer.done) {
+			bool more;
+
+			if (xfer.op == DIAG_REQ_LOG) {
+				net_buf_add_u8(buf, DIAG_SDU_LOG);
+				more = fill_log(buf);
+			} else {
+				net_buf_add_u8(buf, DIAG_SDU_METRICS);
+				more = fill_metrics(buf);
+			}
+
+			xfer.done = !more;
+			xfer.bytes += buf->len;
+
+			/* The data ran out at the end of the previous SDU. */
+			end = (buf->len == 1);
+			if (end) {
+				xfer.bytes -= 1;
+				net_buf_remove_u8(buf);
+			}
+		} else {
+			end = true;
+		}
+
+		if (end) {
+			fill_end(buf);
+		}
+
+		err = bt_l2cap_chan_send(&diag_chan.chan, buf);
+		if (err < 0) {
+			printk("Diagnostics send failed (err %d)\n", err);
+			net_buf_unref(buf);
+			stats.errors++;
+			atomic_clear(&active);
+			return;
+		}
+
+		conn_policy_activity();
+
+		if (end) {
+			atomic_clear(&active);
+		}
+	}
+}
+
+static int diag_recv(struct bt_l2cap_chan *chan, struct net_buf *buf)
+{
+	uint32_t first;
+	uint32_t next;
+
+	if ((buf->len != DIAG_REQ_LEN) || atomic_get(&active)) {
+		stats.errors++;
+		return 0;
+	}
+
+	conn_policy_activity();
+
+	memset(&xfer, 0, sizeof(xfer));
+	xfer.op = buf->data[0];
+	xfer.start = k_uptime_get_32();
+
+	if (!auth_verify(buf->data, DIAG_REQ_HDR_LEN,
+			 &buf->data[DIAG_REQ_HDR_LEN])) {
+		xfer.status = PADLOCK_CMD_STATUS_AUTH_FAILED;
+		audit_log(AUDIT_EVT_AUTH_FAIL, AUDIT_SRC_BLE, AUDIT_USER_NONE,
+			  0);
+	} else if (sdu_len() < DIAG_SDU_MIN) {
+		xfer.status = PADLOCK_CMD_STATUS_NOT_ALLOWED;
+	} else if (xfer.op == DIAG_REQ_LOG) {
+		/* Records still in RAM are written before the work runs. */
+		audit_flush();
+		audit_get_range(&first, &next);
+		xfer.seq = MAX(sys_get_le32(&buf->data[1]), first);
+		xfer.end = next;
+		if ((int32_t)(xfer.end - xfer.seq) < 0) {
+			xfer.seq = xfer.end;
+		}
+	} else if (xfer.op != DIAG_REQ_METRICS) {
+		xfer.status = PADLOCK_CMD_STATUS_INVALID;
+	}
+
+	atomic_set(&active, 1);
+	storage_work_submit(&diag_work);
+
+	return 0;
+}
+
+static void diag_sent(struct bt_l2cap_chan *chan)
+{
+	if (atomic_get(&active)) {
+		storage_work_submit(&diag_work);
+	}
+}
+
+static void diag_disconnected(struct bt_l2cap_chan *chan)
+{
+	if (atomic_clear(&active)) {
+		stats.errors++;
+	}
+}
+
+static const struct bt_l2cap_chan_ops diag_ops = {
+	.recv = diag_recv,
+	.sent = diag_sent,
+	.disconnected = diag_disconnected,
+};
+
+static int diag_accept(struct bt_conn *conn, struct bt_l2cap_server *server,
+		       struct bt_l2cap_chan **chan)
+{
+	if (diag_chan.chan.conn) {
+		return -ENOMEM;
+	}
+
+	memset(&diag_chan, 0, sizeof(diag_chan));
+	diag_chan.chan.ops = &diag_ops;
+	diag_chan.rx.mtu = BT_L2CAP_LE_MIN_MTU;
+
+	*chan = &diag_chan.chan;
+
+	return 0;
+}
+
+static struct bt_l2cap_server diag_server = {
+	.psm = CONFIG_PADLOCK_DIAG_PSM,
+	.accept = diag_accept,
+};
+
+int diag_init(void)
+{
+	return bt_l2cap_server_register(&diag_server);
+}
+
+void diag_get_stats(struct diag_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef DIAG_H_
+#define DIAG_H_
+
+/**@file
+ * @defgroup diag Diagnostics readout
+ * @{
+ * @brief Bulk readout of the audit log and statistics over an L2CAP
+ *	  connection-oriented channel.
+ *
+ * The client opens a channel on PSM CONFIG_PADLOCK_DIAG_PSM and sends a
+ * request of op (1 byte), argument (LE32) and a MAC (see auth.h) over the
+ * nonce and the first five bytes:
+ *
+ * - DIAG_REQ_LOG:     audit log blocks from the given sequence number.
+ * - DIAG_REQ_METRICS: statistics of every module, the argument is unused.
+ *
+ * The lock answers with as many SDUs as needed, each of up to
+ * CONFIG_PADLOCK_DIAG_MTU bytes and starting with its type:
+ *
+ * - DIAG_SDU_LOG:     { length (1 byte), struct audit_block } repeated.
+ * - DIAG_SDU_METRICS: { #diag_metric (1 byte), length (1 byte), stats
+ *                     structure } repeated.
+ * - DIAG_SDU_END:     status (#padlock_cmd_status), payload bytes sent
+ *                     (LE32), time since the request in ms (LE32) and
+ *                     throughput in bytes per second (LE32).
+ *
+ * Data is read from flash straight into the channel buffers, and only
+ * CONFIG_PADLOCK_DIAG_BUF_COUNT buffers are used. The next SDU is
+ * produced when the stack returns one, so the transfer follows the
+ * channel credits without extra RAM.
+ */
+
+#include <zephyr/types.h>
+
+#define DIAG_REQ_LOG		0x01
+#define DIAG_REQ_METRICS	0x02
+
+#define DIAG_SDU_LOG		0x01
+#define DIAG_SDU_METRICS	0x02
+#define DIAG_SDU_END		0xFF
+
+/** @brief Statistics structures in a DIAG_SDU_METRICS SDU. */
+enum diag_metric {
+	DIAG_METRIC_LOCK_CTRL = 1,
+	DIAG_METRIC_MOTOR,
+	DIAG_METRIC_CMD,
+	DIAG_METRIC_NOTIFY,
+	DIAG_METRIC_CONN,
+	DIAG_METRIC_ADV,
+	DIAG_METRIC_AUTH,
+	DIAG_METRIC_STORAGE,
+	DIAG_METRIC_PROV,
+	DIAG_METRIC_CFG,
+	DIAG_METRIC_AUDIT,
+	DIAG_METRIC_DIAG,
+	DIAG_METRIC_SLEEP,
+};
+
+/** @brief Readout statistics. */
+struct diag_stats {
+	/** Completed transfers. */
+	uint32_t transfers;
+	/** Requests rejected or transfers aborted. */
+	uint32_t errors;
+	/** Payload bytes of the last transfer. */
+	uint32_t last_bytes;
+	/** Duration of the last transfer, in milliseconds. */
+	uint32_t last_ms;
+	/** Throughput of the last transfer, in bytes per second. */
+	uint32_t last_bps;
+};
+
+/** @brief Register the L2CAP server.
+ *
+ * Must be called after bt_enable().
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int diag_init(void);
+
+/** @brief Get a snapshot of the readout statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void diag_get_stats(struct diag_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* DIAG_H_ */
@@ -5,12 +5,19 @@
  */
 
 #include <zephyr/kernel.h>
+#include <zephyr/init.h>
 #include <soc.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/util.h>
+#include <zephyr/sys/math_extras.h>
 #include <nrfx.h>
+#include <hal/nrf_gpio.h>
+#include <hal/nrf_power.h>
 #include "led_buttons.h"
+#include "lock_ctrl.h"
+#include "motor.h"
+#include "led_pattern.h"
 
 #define CONFIG_BUTTON_SCAN_INTERVAL 1
 #define BUTTONS_NODE DT_PATH(buttons)
@@ -37,21 +44,222 @@ static const struct gpio_dt_spec padlock_leds[] = {
 #endif
 };
 
+/* Inputs by role, see dts/bindings/smartpadlock,padlock-inputs.yaml. */
+#define INPUT_IS(node, role_str) DT_ENUM_HAS_VALUE(node, role, role_str)
+
+#define INPUT_SPEC_IF_ROLE(node, role_str) \
+	COND_CODE_1(INPUT_IS(node, role_str), (GPIO_DT_SPEC_GET(node, gpios),), ())
+
+#define KEY_PIN_BIT(node) \
+	COND_CODE_1(INPUT_IS(node, key), (BIT(DT_GPIO_PIN(node, gpios)) |), ())
+
+#define ROLE_PIN_BIT(node, role_str) \
+	COND_CODE_1(INPUT_IS(node, role_str), (BIT(DT_GPIO_PIN(node, gpios)) |), ())
+
+#define KEY_PIN_ENTRY(node) \
+	COND_CODE_1(INPUT_IS(node, key), \
+		    ([DT_GPIO_PIN(node, gpios)] = DT_PROP(node, key_code),), ())
+
+#define KEY_CODE_PIN_BIT(node, code) \
+	COND_CODE_1(INPUT_IS(node, key), \
+		    (((DT_PROP(node, key_code) == (code)) ? \
+		      BIT(DT_GPIO_PIN(node, gpios)) : 0) |), ())
+
+static const struct gpio_dt_spec keypad[] = {
+	DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, INPUT_SPEC_IF_ROLE, key)
+};
+
+static const struct gpio_dt_spec lock_detect[] = {
+	DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, INPUT_SPEC_IF_ROLE, lock_detect)
+};
+
+static const struct gpio_dt_spec usb_detect[] = {
+	DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, INPUT_SPEC_IF_ROLE, usb_detect)
+};
+
+BUILD_ASSERT(ARRAY_SIZE(keypad) > 0, "No keypad buttons");
+BUILD_ASSERT(ARRAY_SIZE(lock_detect) == 1, "Exactly one lock-detect input required");
+BUILD_ASSERT(ARRAY_SIZE(usb_detect) == 1, "Exactly one usb-detect input required");
+
+#define KEYPAD_PIN_MASK (DT_FOREACH_CHILD(BUTTONS_NODE, KEY_PIN_BIT) 0)
+#define ENTER_PIN_MASK (DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, KEY_CODE_PIN_BIT, ENTER_BTN1) 0)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(ENTER_PIN_MASK), "Exactly one enter key required");
+
+/* Every input is edge detected through PORT/SENSE, see the gpio0 node. */
+#define SENSE_PIN_MASK \
+	(DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, ROLE_PIN_BIT, key) \
+	 DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, ROLE_PIN_BIT, lock_detect) \
+	 DT_FOREACH_CHILD_VARGS(BUTTONS_NODE, ROLE_PIN_BIT, usb_detect) 0)
+
+BUILD_ASSERT(SENSE_PIN_MASK == DT_PROP(DT_NODELABEL(gpio0), sense_edge_mask),
+	     "gpio0 sense-edge-mask does not match the padlock inputs");
+
+/* Key code of each keypad pin. All inputs are on one GPIO port, so the
+ * pin number alone identifies a key. Only pins in KEYPAD_PIN_MASK are
+ * looked up.
+ */
+static const uint8_t pin_to_key[32] = {
+	DT_FOREACH_CHILD(BUTTONS_NODE, KEY_PIN_ENTRY)
+};
+
 static struct gpio_callback button_cb_data;
-extern uint8_t button_input;
-extern uint8_t pressed_key;
+static struct gpio_callback sense_cb_data;
+
+#define KEY_RING_SIZE CONFIG_PADLOCK_KEY_RING_SIZE
+#define KEY_RING_MASK (KEY_RING_SIZE - 1)
+BUILD_ASSERT(IS_POWER_OF_TWO(KEY_RING_SIZE), "Key ring size must be a power of two");
+
+/* Single producer (debounce timer) / single consumer (lock controller)
+ * ring of key events. Head is only written by the producer and tail only
+ * by the consumer, so no lock is needed.
+ */
+static struct user_key_event key_ring[KEY_RING_SIZE];
+static atomic_t key_head;
+static atomic_t key_tail;
+static atomic_t key_dropped;
+
+/* Keypad pins that saw an edge since the debounce timer last fired. */
+static atomic_t key_pending;
+static uint32_t key_edge_time;
+
+static void key_ring_put(uint8_t key, uint32_t timestamp)
+{
+	atomic_val_t head = atomic_get(&key_head);
+
+	if ((head - atomic_get(&key_tail)) >= KEY_RING_SIZE) {
+		atomic_inc(&key_dropped);
+		return;
+	}
+
+	key_ring[head & KEY_RING_MASK].key = key;
+	key_ring[head & KEY_RING_MASK].timestamp = timestamp;
+	atomic_set(&key_head, head + 1);
+}
+
+bool user_key_get(struct user_key_event *evt)
+{
+	atomic_val_t tail = atomic_get(&key_tail);
+
+	if (tail == atomic_get(&key_head)) {
+		return false;
+	}
+
+	*evt = key_ring[tail & KEY_RING_MASK];
+	atomic_set(&key_tail, tail + 1);
+
+	return true;
+}
+
+uint32_t user_key_dropped(void)
+{
+	return atomic_get(&key_dropped);
+}
+
+/* Queue a press of each keypad pin in the mask. */
+static void keys_report(uint32_t pins, uint32_t timestamp)
+{
+	pins &= KEYPAD_PIN_MASK;
+	if (!pins) {
+		return;
+	}
+
+	/* One pass per held key, lowest pin first. */
+	do {
+		key_ring_put(pin_to_key[u32_count_trailing_zeros(pins)],
+			     timestamp);
+		pins &= pins - 1;
+	} while (pins);
+
+	lock_ctrl_post(LOCK_EVT_KEYPAD);
+}
+
+/* Runs once the keypad has been quiet for the debounce time. Only keys
+ * that are still held are reported, which filters out bounce and glitches.
+ */
+static void debounce_timer_expiry(struct k_timer *timer)
+{
+	uint32_t pins = atomic_clear(&key_pending);
+	gpio_port_value_t levels;
+
+	/* One port read gives all keys, simultaneous presses included. */
+	if (gpio_port_get(keypad[0].port, &levels)) {
+		return;
+	}
+
+	keys_report(pins & levels, key_edge_time);
+}
+
+/* Pins that woke the SoC from System OFF. Their edge came before the
+ * reset, so it never reaches the GPIO callback.
+ */
+static uint32_t wake_pins;
+
+/* The LATCH register records the pins that met their SENSE condition
+ * and survives the wake reset. It is read before the GPIO driver starts.
+ */
+static int wake_pins_capture(void)
+{
+	if (nrf_power_resetreas_get(NRF_POWER) & NRF_POWER_RESETREAS_OFF_MASK) {
+		nrf_gpio_latches_read_and_clear(0, 1, &wake_pins);
+	}
+
+	return 0;
+}
+
+SYS_INIT(wake_pins_capture, PRE_KERNEL_1, 0);
+
+static K_TIMER_DEFINE(debounce_timer, debounce_timer_expiry, NULL);
 
 static void button_pressed(const struct device *dev, struct gpio_callback *cb,
 		    uint32_t pins)
 {
-	button_input = 1;
+	if (atomic_or(&key_pending, pins & KEYPAD_PIN_MASK) == 0) {
+		key_edge_time = k_uptime_get_32();
+	}
 
-	for (size_t i = 0; i < 5; i++) {
-		if ((1 << padlock_buttons[i].pin) == pins){
-			pressed_key = i;
-		}
+	/* Every bounce restarts the timer, so it fires once the pin settles. */
+	k_timer_start(&debounce_timer, K_MSEC(CONFIG_PADLOCK_KEY_DEBOUNCE_MS),
+		      K_NO_WAIT);
+}
+
+/* Debounced levels of the lock detect and USB detect inputs. */
+static atomic_t lock_level;
+static atomic_t usb_level;
+
+static void sense_timer_expiry(struct k_timer *timer)
+{
+	uint32_t events = 0;
+	atomic_val_t val;
+
+	val = gpio_pin_get_dt(&lock_detect[0]);
+	if (atomic_set(&lock_level, val) != val) {
+		events |= LOCK_EVT_LOCK_DETECT;
+	}
+
+	val = gpio_pin_get_dt(&usb_detect[0]);
+	if (atomic_set(&usb_level, val) != val) {
+		events |= LOCK_EVT_USB_DETECT;
+	}
+
+	/* Bounce that settles back to the old level is not reported. */
+	if (events) {
+		lock_ctrl_post(events);
+	}
+}
+
+static K_TIMER_DEFINE(sense_timer, sense_timer_expiry, NULL);
+
+static void sense_changed(const struct device *dev,
+			  struct gpio_callback *cb, uint32_t pins)
+{
+	/* The motor cut-off must not wait for the debounce. */
+	if (pins & BIT(lock_detect[0].pin)) {
+		motor_on_lock_detect(gpio_pin_get_dt(&lock_detect[0]));
 	}
 
+	k_timer_start(&sense_timer, K_MSEC(CONFIG_PADLOCK_SENSE_DEBOUNCE_MS),
+		      K_NO_WAIT);
 }
 
 uint32_t get_padlock_buttons(void)
@@ -70,97 +278,115 @@ uint32_t get_padlock_buttons(void)
 }
 uint8_t get_lock_status(void)
 {
-	return gpio_pin_get_dt(&padlock_buttons[LOCK_BTN6]);
+	return atomic_get(&lock_level);
 }
 uint8_t get_usb_status(void)
 {
-	return gpio_pin_get_dt(&padlock_buttons[USB_BTN7]);
+	return atomic_get(&usb_level);
 }
 uint8_t get_enter_status(void)
 {
-	return gpio_pin_get_dt(&padlock_buttons[ENTER_BTN1]);
+	gpio_port_value_t levels;
+
+	if (gpio_port_get(keypad[0].port, &levels)) {
+		return 0;
+	}
+
+	return (levels & ENTER_PIN_MASK) ? 1 : 0;
 }
 void user_leds_init(void)
 {
 	for (size_t i = 0; i < ARRAY_SIZE(padlock_leds); i++) {
 		gpio_pin_configure_dt(&padlock_leds[i], GPIO_OUTPUT);
 	}
+
+	led_pattern_init();
 }
 
 void user_buttons_init(void)
 {
+	/* Pull resistors come from the devicetree flags of each input. */
 	for (size_t i = 0; i < ARRAY_SIZE(padlock_buttons); i++) {
-		/* Enable pull resistor towards the inactive voltage. */
-		gpio_flags_t flags =
-			padlock_buttons[i].dt_flags & GPIO_ACTIVE_LOW ?
-			GPIO_PULL_UP : GPIO_PULL_DOWN;
-
-		if (i == USB_BTN7){
-			gpio_pin_configure_dt(&padlock_buttons[i], GPIO_INPUT);
-		}else{
-			gpio_pin_configure_dt(&padlock_buttons[i], GPIO_INPUT | flags);
-		}
+		gpio_pin_configure_dt(&padlock_buttons[i], GPIO_INPUT);
+	}
+
+	/* The press that woke the lock is the first key of the PIN. It is
+	 * queued before the keypad interrupts are enabled, so the debounce
+	 * timer is still the only producer of the key ring afterwards.
+	 */
+	keys_report(wake_pins, k_uptime_get_32());
+	wake_pins = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(keypad); i++) {
+		gpio_pin_interrupt_configure_dt(&keypad[i], GPIO_INT_EDGE_TO_ACTIVE);
 	}
+	gpio_init_callback(&button_cb_data, button_pressed, KEYPAD_PIN_MASK);
+	gpio_add_callback(keypad[0].port, &button_cb_data);
 
-	uint32_t pin_mask = 0;
+	/* Lock detect and USB detect report both edges; the debounced level
+	 * is sampled once here and then only updated from the interrupt.
+	 */
+	atomic_set(&lock_level, gpio_pin_get_dt(&lock_detect[0]));
+	atomic_set(&usb_level, gpio_pin_get_dt(&usb_detect[0]));
 
-	for (size_t i = 0; i < 5; i++) {
-		/* Module starts in scanning mode and will switch to
-		 * callback mode if no button is pressed.
-		 */
+	gpio_init_callback(&sense_cb_data, sense_changed,
+			   BIT(lock_detect[0].pin) | BIT(usb_detect[0].pin));
+	gpio_add_callback(lock_detect[0].port, &sense_cb_data);
 
-		gpio_pin_interrupt_configure_dt(&padlock_buttons[i], GPIO_INT_EDGE_RISING);
-		
-		
-		/*err = gpio_pin_interrupt_configure_dt(&padlock_buttons[i],
-					      GPIO_INT_DISABLE);
-		if (err) {
-			printk("Cannot disable callbacks()");
-			return err;
-		}
-		*/
-		pin_mask |= BIT(padlock_buttons[i].pin);
-		
+	gpio_pin_interrupt_configure_dt(&lock_detect[0], GPIO_INT_EDGE_BOTH);
+	gpio_pin_interrupt_configure_dt(&usb_detect[0], GPIO_INT_EDGE_BOTH);
+}
+
+static void sense_wake_enable(const struct gpio_dt_spec *spec)
+{
+	gpio_pin_interrupt_configure_dt(spec, gpio_pin_get_dt(spec) ?
+					GPIO_INT_LEVEL_INACTIVE :
+					GPIO_INT_LEVEL_ACTIVE);
+}
+
+/* Level interrupts are implemented with the pin SENSE mechanism, which
+ * is also what wakes the SoC from System OFF. Lock detect and USB detect
+ * wake on a change from their current level.
+ */
+void user_buttons_wake_enable(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(keypad); i++) {
+		gpio_pin_interrupt_configure_dt(&keypad[i],
+						GPIO_INT_LEVEL_ACTIVE);
 	}
-	gpio_init_callback(&button_cb_data, button_pressed, pin_mask);
-	gpio_add_callback(padlock_buttons[0].port, &button_cb_data);
 
-	gpio_pin_interrupt_configure_dt(&padlock_buttons[5], GPIO_INT_DISABLE);
-	gpio_pin_interrupt_configure_dt(&padlock_buttons[6], GPIO_INT_DISABLE);
+	sense_wake_enable(&lock_detect[0]);
+	sense_wake_enable(&usb_detect[0]);
 }
 
+/* The indicator LEDs are driven by the PWM, see led_pattern.c. */
 void user_set_led(uint8_t led_idx, uint32_t val)
 {
-	gpio_pin_set_dt(&padlock_leds[led_idx], val);
+	if (led_idx <= WHITE_LED4) {
+		led_pattern_set(led_idx, val);
+	} else {
+		gpio_pin_set_dt(&padlock_leds[led_idx], val);
+	}
 }
 
-void user_close_lock(void)
+void user_flash_led(uint8_t led_idx)
 {
-	int err;
-	user_set_led(GREEN_LED2, 1);
-	gpio_pin_set_dt(&padlock_leds[AIN_GPIO], 1);
-	gpio_pin_set_dt(&padlock_leds[BIN_GPIO], 0);
-	k_sleep(K_MSEC(500));
-	gpio_pin_set_dt(&padlock_leds[AIN_GPIO], 0);
-	user_set_led(GREEN_LED2, 0);
+	led_pattern_play(led_idx, &led_pattern_flash);
 }
 
-void user_open_lock(void)
+void user_motor_drive(uint8_t ain, uint8_t bin)
 {
-	int err;
-	user_set_led(GREEN_LED2, 1);
+	/* Release both legs before driving one, never drive both. */
 	gpio_pin_set_dt(&padlock_leds[AIN_GPIO], 0);
-	gpio_pin_set_dt(&padlock_leds[BIN_GPIO], 1);
-	k_sleep(K_MSEC(500));
 	gpio_pin_set_dt(&padlock_leds[BIN_GPIO], 0);
-	user_set_led(GREEN_LED2, 0);
+	if (ain && bin) {
+		return;
+	}
+	gpio_pin_set_dt(&padlock_leds[AIN_GPIO], ain);
+	gpio_pin_set_dt(&padlock_leds[BIN_GPIO], bin);
 }
 
 void user_set_led_all_off(void)
 {
-	user_set_led(RED_LED1, 0);
-	user_set_led(GREEN_LED2, 0);
-	user_set_led(BLUE_LED3, 0);
-	user_set_led(WHITE_LED4, 0);
-
+	led_pattern_all_off();
 }
\ No newline at end of file
@@ -39,27 +39,44 @@
 #define DOWN_BTN3          	2		// DOWN
 #define RIGHT_BTN4          3		// RIGHT
 #define LEFT_BTN5          	4		// LEFT
-#define LOCK_BTN6			5		// LOCKDETECT
-#define USB_BTN7			6		// USBDETECT
 
 #define ENTER_BTN1_MSK      BIT(ENTER_BTN1)
 #define UP_BTN2_MSK      	BIT(UP_BTN2)
 #define DOWN_BTN3_MSK      	BIT(DOWN_BTN3)
 #define RIGHT_BTN4_MSK      BIT(RIGHT_BTN4)
 #define LEFT_BTN5_MSK      	BIT(LEFT_BTN5)
-#define LOCK_BTN6_MSK		BIT(LOCK_BTN6)
-#define USB_BTN7_MSK		BIT(USB_BTN7)
 
 #define USER_ALL_BTNS_MSK  (ENTER_BTN1_MSK | UP_BTN2_MSK | \
-			  DOWN_BTN3_MSK | RIGHT_BTN4_MSK | LEFT_BTN5_MSK | LOCK_BTN6_MSK | USB_BTN7_MSK)
+			  DOWN_BTN3_MSK | RIGHT_BTN4_MSK | LEFT_BTN5_MSK)
+
+/** A debounced keypad press. */
+struct user_key_event {
+	/** Uptime of the first edge, in milliseconds. */
+	uint32_t timestamp;
+	/** Key code from the devicetree, ENTER_BTN1 to LEFT_BTN5. */
+	uint8_t key;
+};
+
+/** Take the oldest pending key event.
+ *
+ * @param[out] evt Filled with the key event.
+ *
+ * @return true if an event was returned, false if none is pending.
+ */
+bool user_key_get(struct user_key_event *evt);
+
+/** Number of key events dropped because the key ring was full. */
+uint32_t user_key_dropped(void);
 
 uint32_t get_padlock_buttons(void);
 void user_leds_init(void);
 void user_buttons_init(void);
+void user_buttons_wake_enable(void);
 void user_set_led(uint8_t led_idx, uint32_t val);
+/* Turn on a feedback LED for a short time, without blocking. */
+void user_flash_led(uint8_t led_idx);
 uint8_t get_lock_status(void);
-void user_open_lock(void);
-void user_close_lock(void);
+void user_motor_drive(uint8_t ain, uint8_t bin);
 uint8_t get_usb_status(void);
 uint8_t get_enter_status(void);
 void user_set_led_all_off(void);
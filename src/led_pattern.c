@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/sys/printk.h>
+#include <soc.h>
+#include <nrfx_pwm.h>
+
+#include "led_pattern.h"
+#include "led_buttons.h"
+
+#define LED_COUNT		NRF_PWM_CHANNEL_COUNT
+#define LED_STEPS_MAX		CONFIG_PADLOCK_LED_PATTERN_STEPS
+
+/* 125 kHz / 250 gives a 2 ms PWM period. */
+#define LED_PWM_TOP		250
+#define LED_PWM_PERIOD_MS	2
+
+/* Set for an output that is high during the duty cycle. */
+#define LED_PWM_ACTIVE_HIGH	0x8000
+
+#define LED_NO_PATTERN		0xFF
+
+#define LED_PIN(label)		NRF_DT_GPIOS_TO_PSEL(DT_NODELABEL(label), gpios)
+
+BUILD_ASSERT(WHITE_LED4 < LED_COUNT, "More LEDs than PWM channels");
+
+static const uint8_t blink_levels[] = { 100, 0 };
+static const uint8_t flash_levels[] = { 100 };
+static const uint8_t double_flash_levels[] = { 100, 0, 100 };
+static const uint8_t breathe_levels[] = {
+	0, 4, 12, 25, 41, 59, 75, 88, 96, 100, 96, 88, 75, 59, 41, 25, 12, 4,
+};
+
+const struct led_pattern led_pattern_blink = {
+	.levels = blink_levels,
+	.steps = ARRAY_SIZE(blink_levels),
+	.step_ms = 500,
+};
+
+const struct led_pattern led_pattern_flash = {
+	.levels = flash_levels,
+	.steps = ARRAY_SIZE(flash_levels),
+	.step_ms = 500,
+	.repeat = 1,
+};
+
+const struct led_pattern led_pattern_double_flash = {
+	.levels = double_flash_levels,
+	.steps = ARRAY_SIZE(double_flash_levels),
+	.step_ms = 120,
+	.repeat = 1,
+};
+
+const struct led_pattern led_pattern_breathe = {
+	.levels = breathe_levels,
+	.steps = ARRAY_SIZE(breathe_levels),
+	.step_ms = 80,
+};
+
+static const nrfx_pwm_t pwm = NRFX_PWM_INSTANCE(0);
+
+struct led_play {
+	const struct led_pattern *pattern;
+	uint8_t led;
+};
+
+/* The PWM reads its sequence from RAM. A new sequence is built in the
+ * buffer that is not playing, so the switch is glitch free.
+ */
+static nrf_pwm_values_individual_t seq_buf[2][LED_STEPS_MAX];
+static uint8_t seq_idx;
+
+static struct led_play loop = { .led = LED_NO_PATTERN };
+static struct led_play once = { .led = LED_NO_PATTERN };
+static uint8_t steady_mask;
+static struct k_spinlock lock;
+
+static uint16_t led_value(uint8_t percent)
+{
+	return LED_PWM_ACTIVE_HIGH | (MIN(percent, 100) * LED_PWM_TOP / 100);
+}
+
+static void channel_set(nrf_pwm_values_individual_t *v, uint8_t ch,
+			uint16_t value)
+{
+	switch (ch) {
+	case 0:
+		v->channel_0 = value;
+		break;
+	case 1:
+		v->channel_1 = value;
+		break;
+	case 2:
+		v->channel_2 = value;
+		break;
+	default:
+		v->channel_3 = value;
+		break;
+	}
+}
+
+/* Called with the lock held. */
+static void refresh(void)
+{
+	const struct led_play *play = (once.led != LED_NO_PATTERN) ? &once :
+				      (loop.led != LED_NO_PATTERN) ? &loop :
+				      NULL;
+	nrf_pwm_values_individual_t *buf;
+	nrf_pwm_sequence_t seq = { 0 };
+	uint8_t steps = play ? MIN(play->pattern->steps, LED_STEPS_MAX) : 1;
+
+	if (!play && !steady_mask) {
+		nrfx_pwm_stop(&pwm, false);
+		return;
+	}
+
+	seq_idx ^= 1;
+	buf = seq_buf[seq_idx];
+
+	for (uint8_t i = 0; i < steps; i++) {
+		for (uint8_t ch = 0; ch < LED_COUNT; ch++) {
+			uint8_t level = (steady_mask & BIT(ch)) ? 100 : 0;
+
+			if (play && (ch == play->led)) {
+				level = play->pattern->levels[i];
+			}
+			channel_set(&buf[i], ch, led_value(level));
+		}
+	}
+
+	seq.values.p_individual = buf;
+	seq.length = NRF_PWM_VALUES_LENGTH(buf[0]) * steps;
+	seq.repeats = play ? (MAX(play->pattern->step_ms / LED_PWM_PERIOD_MS,
+				  1) - 1) : 0;
+
+	if (play && play->pattern->repeat) {
+		(void)nrfx_pwm_simple_playback(&pwm, &seq,
+					       play->pattern->repeat,
+					       NRFX_PWM_FLAG_STOP);
+	} else {
+		(void)nrfx_pwm_simple_playback(&pwm, &seq, 1,
+					       NRFX_PWM_FLAG_LOOP |
+					       NRFX_PWM_FLAG_NO_EVT_FINISHED);
+	}
+}
+
+/* Only one shot patterns report their end. */
+static void pwm_handler(nrfx_pwm_evt_type_t event_type, void *context)
+{
+	k_spinlock_key_t key;
+
+	if (event_type != NRFX_PWM_EVT_FINISHED) {
+		return;
+	}
+
+	key = k_spin_lock(&lock);
+	once.led = LED_NO_PATTERN;
+	refresh();
+	k_spin_unlock(&lock, key);
+}
+
+void led_pattern_init(void)
+{
+	nrfx_pwm_config_t config = NRFX_PWM_DEFAULT_CONFIG(
+		LED_PIN(red_led), LED_PIN(green_led),
+		LED_PIN(blue_led), LED_PIN(white_led));
+	nrfx_err_t err;
+
+	config.base_clock = NRF_PWM_CLK_125kHz;
+	config.top_value = LED_PWM_TOP;
+	config.load_mode = NRF_PWM_LOAD_INDIVIDUAL;
+
+	IRQ_CONNECT(DT_IRQN(DT_NODELABEL(pwm0)), DT_IRQ(DT_NODELABEL(pwm0), priority),
+		    nrfx_isr, nrfx_pwm_0_irq_handler, 0);
+
+	err = nrfx_pwm_init(&pwm, &config, pwm_handler, NULL);
+	if (err != NRFX_SUCCESS) {
+		printk("LED PWM init failed (err %d)\n", err);
+	}
+}
+
+void led_pattern_play(uint8_t led, const struct led_pattern *pattern)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (pattern->repeat) {
+		once.pattern = pattern;
+		once.led = led;
+	} else {
+		loop.pattern = pattern;
+		loop.led = led;
+	}
+	refresh();
+
+	k_spin_unlock(&lock, key);
+}
+
+void led_pattern_stop(uint8_t led)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	if (loop.led == led) {
+		loop.led = LED_NO_PATTERN;
+		if (once.led == LED_NO_PATTERN) {
+			refresh();
+		}
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void led_pattern_set(uint8_t led, bool on)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+	uint8_t mask = on ? (steady_mask | BIT(led)) : (steady_mask & ~BIT(led));
+
+	if (mask != steady_mask) {
+		steady_mask = mask;
+		refresh();
+	}
+
+	k_spin_unlock(&lock, key);
+}
+
+void led_pattern_all_off(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&lock);
+
+	loop.led = LED_NO_PATTERN;
+	once.led = LED_NO_PATTERN;
+	steady_mask = 0;
+	refresh();
+
+	k_spin_unlock(&lock, key);
+}
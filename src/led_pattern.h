@@ -0,0 +1,86 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef LED_PATTERN_H_
+#define LED_PATTERN_H_
+
+/**@file
+ * @defgroup led_pattern LED patterns
+ * @{
+ * @brief LED feedback played by the PWM peripheral.
+ *
+ * The four indicator LEDs are the four channels of PWM0. A pattern is a
+ * list of brightness steps of equal length, which is turned into a PWM
+ * sequence once and then played by EasyDMA without the CPU.
+ *
+ * One LED at a time plays a pattern, the others show their steady level.
+ * A pattern with a repeat count is played on top of a looping pattern,
+ * which resumes afterwards. The PWM, and with it the high frequency
+ * clock, is stopped while all LEDs are off.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Declarative LED pattern. */
+struct led_pattern {
+	/** Brightness of each step, in percent. */
+	const uint8_t *levels;
+	/** Number of steps, at most CONFIG_PADLOCK_LED_PATTERN_STEPS. */
+	uint8_t steps;
+	/** Duration of each step, in milliseconds. */
+	uint16_t step_ms;
+	/** Times the pattern is played, 0 to loop until replaced. */
+	uint8_t repeat;
+};
+
+/** On and off every 500 ms, looping. */
+extern const struct led_pattern led_pattern_blink;
+/** On for 500 ms, once. */
+extern const struct led_pattern led_pattern_flash;
+/** Two short flashes, once. */
+extern const struct led_pattern led_pattern_double_flash;
+/** Smooth fade in and out, looping. */
+extern const struct led_pattern led_pattern_breathe;
+
+/** @brief Take over the LED pins.
+ *
+ * Must be called after user_leds_init().
+ */
+void led_pattern_init(void);
+
+/** @brief Play a pattern.
+ *
+ * Replaces the pattern currently played. Safe to call from any context,
+ * including interrupts.
+ *
+ * @param led LED index, RED_LED1 to WHITE_LED4.
+ * @param pattern Pattern to play.
+ */
+void led_pattern_play(uint8_t led, const struct led_pattern *pattern);
+
+/** @brief Stop the looping pattern of an LED.
+ *
+ * @param led LED index, RED_LED1 to WHITE_LED4.
+ */
+void led_pattern_stop(uint8_t led);
+
+/** @brief Set the steady level of an LED.
+ *
+ * Shown whenever the LED does not play a pattern.
+ *
+ * @param led LED index, RED_LED1 to WHITE_LED4.
+ * @param on Whether the LED is on.
+ */
+void led_pattern_set(uint8_t led, bool on);
+
+/** @brief Stop all patterns and turn all LEDs off. */
+void led_pattern_all_off(void);
+
+/**
+ * @}
+ */
+
+#endif /* LED_PATTERN_H_ */
@@ -0,0 +1,318 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <errno.h>
+
+#include "lock_ctrl.h"
+#include "led_buttons.h"
+#include "motor.h"
+#include "audit.h"
+
+static K_EVENT_DEFINE(lock_events);
+
+static enum lock_state state = LOCK_STATE_LOCKED;
+static bool auto_close_en;
+static uint8_t lock_detect_prev;
+static bool restored;
+/* The last drive ended with the shackle out, cleared by a good drive. */
+static bool motor_fault;
+
+static int motor_result;
+static enum motor_dir motor_dir;
+
+/* Operation requested by another thread, executed by the controller. */
+static K_SEM_DEFINE(req_sem, 0, 1);
+static atomic_t req_pending;
+static bool req_in_progress;
+static int req_result;
+
+static uint32_t post_cycles;
+static uint32_t window_start;
+static uint32_t window_count;
+static struct lock_ctrl_stats stats;
+
+static void relock_timer_expiry(struct k_timer *timer)
+{
+	lock_ctrl_post(LOCK_EVT_RELOCK_TMO);
+}
+
+static K_TIMER_DEFINE(relock_timer, relock_timer_expiry, NULL);
+
+static void relock_poll_start(void)
+{
+	k_timer_start(&relock_timer, K_MSEC(CONFIG_PADLOCK_RELOCK_TIMEOUT_MS),
+		      K_MSEC(CONFIG_PADLOCK_RELOCK_TIMEOUT_MS));
+}
+
+static void motor_done(enum motor_dir dir, int result, uint32_t drive_ms)
+{
+	motor_result = result;
+	motor_dir = dir;
+	lock_ctrl_post(LOCK_EVT_MOTOR_DONE);
+}
+
+void lock_ctrl_init(void)
+{
+	lock_detect_prev = get_lock_status();
+	window_start = k_uptime_get_32();
+
+	/* After a cold boot the lock starts open if the shackle is out, so
+	 * it is not mistaken for tampering. After System OFF the saved state
+	 * is trusted: a shackle out of a LOCKED lock was forced while it was
+	 * off, and stays LOCKED so it is reported.
+	 */
+	if (!lock_detect_prev && (state != LOCK_STATE_OPEN)) {
+		if (restored) {
+			audit_log(AUDIT_EVT_TAMPER, AUDIT_SRC_AUTO,
+				  AUDIT_USER_NONE, 0);
+		} else {
+			state = LOCK_STATE_OPEN;
+			relock_poll_start();
+		}
+	}
+
+	motor_init(motor_done);
+}
+
+void lock_ctrl_restore(enum lock_state saved, bool saved_fault,
+		       const struct lock_ctrl_stats *saved_stats)
+{
+	motor_fault = saved_fault;
+	stats = *saved_stats;
+	stats.wakeups_per_sec = 0;
+	restored = true;
+
+	if (saved == LOCK_STATE_OPEN) {
+		state = LOCK_STATE_OPEN;
+		k_timer_start(&relock_timer, K_NO_WAIT,
+			      K_MSEC(CONFIG_PADLOCK_RELOCK_TIMEOUT_MS));
+	}
+}
+
+void lock_ctrl_post(uint32_t events)
+{
+	post_cycles = k_cycle_get_32();
+	k_event_post(&lock_events, events);
+}
+
+static void count_wakeup(void)
+{
+	uint32_t now = k_uptime_get_32();
+	uint32_t latency = k_cycle_get_32() - post_cycles;
+
+	stats.wakeups++;
+	window_count++;
+
+	if (latency > stats.post_latency_max_cycles) {
+		stats.post_latency_max_cycles = latency;
+	}
+
+	if ((now - window_start) >= MSEC_PER_SEC) {
+		stats.wakeups_per_sec = window_count * MSEC_PER_SEC /
+					(now - window_start);
+		window_count = 0;
+		window_start = now;
+	}
+}
+
+uint32_t lock_ctrl_wait(void)
+{
+	uint32_t events;
+
+	events = k_event_wait(&lock_events, LOCK_EVT_ALL, false, K_FOREVER);
+	k_event_clear(&lock_events, events);
+
+	count_wakeup();
+
+	return events;
+}
+
+static int relock(void)
+{
+	int err;
+
+	err = motor_start(MOTOR_DIR_CLOSE);
+	if (err) {
+		return err;
+	}
+
+	k_timer_stop(&relock_timer);
+	state = LOCK_STATE_RELOCKING;
+
+	return 0;
+}
+
+int lock_ctrl_open(void)
+{
+	int err;
+
+	if ((state == LOCK_STATE_UNLOCKING) ||
+	    (state == LOCK_STATE_RELOCKING)) {
+		return -EBUSY;
+	}
+
+	err = motor_start(MOTOR_DIR_OPEN);
+	if (err) {
+		return err;
+	}
+
+	k_timer_stop(&relock_timer);
+	state = LOCK_STATE_UNLOCKING;
+
+	return 0;
+}
+
+int lock_ctrl_close(void)
+{
+	if ((state == LOCK_STATE_UNLOCKING) ||
+	    (state == LOCK_STATE_RELOCKING)) {
+		return -EBUSY;
+	}
+
+	return relock();
+}
+
+static void request_done(int result)
+{
+	req_in_progress = false;
+	req_result = result;
+	k_sem_give(&req_sem);
+}
+
+static void request_start(void)
+{
+	int err;
+
+	switch (atomic_clear(&req_pending)) {
+	case LOCK_REQ_OPEN:
+		err = lock_ctrl_open();
+		break;
+	case LOCK_REQ_CLOSE:
+		err = lock_ctrl_close();
+		break;
+	default:
+		return;
+	}
+
+	if (err) {
+		request_done(err);
+	} else {
+		req_in_progress = true;
+	}
+}
+
+static void motor_finished(void)
+{
+	enum audit_src src = req_in_progress ? AUDIT_SRC_BLE : AUDIT_SRC_AUTO;
+
+	if (motor_result == -ETIMEDOUT) {
+		stats.motor_timeouts++;
+		motor_fault = true;
+		audit_log(AUDIT_EVT_MOTOR_STALL, src, AUDIT_USER_NONE,
+			  motor_dir);
+	} else if (!motor_result) {
+		motor_fault = false;
+	}
+
+	if (req_in_progress) {
+		request_done(motor_result);
+	}
+
+	if ((state == LOCK_STATE_UNLOCKING) ||
+	    ((state == LOCK_STATE_RELOCKING) && motor_result)) {
+		if (state == LOCK_STATE_UNLOCKING) {
+			stats.unlocks++;
+		}
+		state = LOCK_STATE_OPEN;
+
+		/* Keep checking for the shackle until it is closed again. */
+		relock_poll_start();
+	} else if (state == LOCK_STATE_RELOCKING) {
+		state = LOCK_STATE_LOCKED;
+		stats.relocks++;
+		audit_log(AUDIT_EVT_LOCK, src, AUDIT_USER_NONE, 0);
+	}
+}
+
+void lock_ctrl_process(uint32_t events)
+{
+	uint8_t detect = get_lock_status();
+	bool inserted = (lock_detect_prev == 0) && (detect == 1);
+
+	lock_detect_prev = detect;
+
+	if (events & LOCK_EVT_MOTOR_DONE) {
+		motor_finished();
+	}
+
+	if (events & LOCK_EVT_REQUEST) {
+		request_start();
+	}
+
+	if ((state != LOCK_STATE_OPEN) || auto_close_en) {
+		return;
+	}
+
+	/* Relock as soon as the shackle is pushed back in, or when the
+	 * relock timeout expires with the shackle still in place.
+	 */
+	if (((events & LOCK_EVT_LOCK_DETECT) && inserted) ||
+	    ((events & LOCK_EVT_RELOCK_TMO) && (detect == 1))) {
+		(void)relock();
+	}
+}
+
+int lock_ctrl_request(enum lock_req req, k_timeout_t timeout)
+{
+	k_sem_reset(&req_sem);
+	atomic_set(&req_pending, req);
+	lock_ctrl_post(LOCK_EVT_REQUEST);
+
+	if (k_sem_take(&req_sem, timeout)) {
+		return -EAGAIN;
+	}
+
+	return req_result;
+}
+
+void lock_ctrl_set_auto_close(bool en)
+{
+	auto_close_en = en;
+}
+
+enum lock_state lock_ctrl_get_state(void)
+{
+	return state;
+}
+
+bool lock_ctrl_motor_fault(void)
+{
+	return motor_fault;
+}
+
+uint8_t lock_ctrl_lock_detect(void)
+{
+	return get_lock_status();
+}
+
+uint8_t lock_ctrl_usb_detect(void)
+{
+	return get_usb_status();
+}
+
+void lock_ctrl_get_stats(struct lock_ctrl_stats *out)
+{
+	uint32_t now = k_uptime_get_32();
+
+	*out = stats;
+
+	/* No wakeups at all for a full window means the rate is zero. */
+	if ((now - window_start) >= MSEC_PER_SEC) {
+		out->wakeups_per_sec = window_count * MSEC_PER_SEC /
+				       (now - window_start);
+	}
+}
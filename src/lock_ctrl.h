@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef LOCK_CTRL_H_
+#define LOCK_CTRL_H_
+
+/**@file
+ * @defgroup lock_ctrl Lock controller
+ * @{
+ * @brief Event-driven controller for the padlock shackle.
+ *
+ * Input sources (GATT writes, keypad, lock detect, USB detect) post events
+ * with lock_ctrl_post(). The application thread sleeps in lock_ctrl_wait()
+ * until at least one event is pending, so an idle lock never wakes up.
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+/** A keypad button was pressed. */
+#define LOCK_EVT_KEYPAD		BIT(0)
+/** Another thread requested a lock operation. */
+#define LOCK_EVT_REQUEST	BIT(1)
+/** The lock detect input changed state. */
+#define LOCK_EVT_LOCK_DETECT	BIT(2)
+/** The USB detect input changed state. */
+#define LOCK_EVT_USB_DETECT	BIT(3)
+/** The relock timer expired. */
+#define LOCK_EVT_RELOCK_TMO	BIT(4)
+/** A central connected or disconnected. */
+#define LOCK_EVT_CONN		BIT(5)
+/** The motor finished a drive. */
+#define LOCK_EVT_MOTOR_DONE	BIT(7)
+/** The filtered battery voltage changed. */
+#define LOCK_EVT_BATTERY	BIT(8)
+
+#define LOCK_EVT_ALL		(LOCK_EVT_KEYPAD | LOCK_EVT_REQUEST | \
+				 LOCK_EVT_LOCK_DETECT | LOCK_EVT_USB_DETECT | \
+				 LOCK_EVT_RELOCK_TMO | LOCK_EVT_CONN | \
+				 LOCK_EVT_MOTOR_DONE | LOCK_EVT_BATTERY)
+
+/** @brief Shackle state as seen by the controller. */
+enum lock_state {
+	/** Shackle is locked, motor idle. */
+	LOCK_STATE_LOCKED,
+	/** Motor is driving the shackle open. */
+	LOCK_STATE_UNLOCKING,
+	/** Shackle is released, waiting for relock. */
+	LOCK_STATE_OPEN,
+	/** Motor is driving the shackle closed. */
+	LOCK_STATE_RELOCKING,
+};
+
+/** @brief Lock operations that other threads can request. */
+enum lock_req {
+	LOCK_REQ_OPEN = 1,
+	LOCK_REQ_CLOSE,
+};
+
+/** @brief Controller statistics. */
+struct lock_ctrl_stats {
+	/** Total number of times the controller thread woke up. */
+	uint32_t wakeups;
+	/** Wakeups counted over the last complete one second window. */
+	uint32_t wakeups_per_sec;
+	/** Worst case latency from lock_ctrl_post() to wakeup, in cycles. */
+	uint32_t post_latency_max_cycles;
+	/** Number of unlock operations. */
+	uint32_t unlocks;
+	/** Number of relock operations. */
+	uint32_t relocks;
+	/** Number of closes that ended with the shackle out. */
+	uint32_t motor_timeouts;
+};
+
+/** @brief Initialize the controller.
+ *
+ * Must be called after user_buttons_init(). After a cold boot the
+ * controller starts LOCKED with the shackle in and OPEN with the shackle
+ * out. After lock_ctrl_restore() it keeps the saved state, and a LOCKED
+ * lock found with the shackle out is logged as AUDIT_EVT_TAMPER.
+ */
+void lock_ctrl_init(void);
+
+/** @brief Post one or more events to the controller.
+ *
+ * Safe to call from any context, including interrupts.
+ *
+ * @param events Bitmask of LOCK_EVT_* values.
+ */
+void lock_ctrl_post(uint32_t events);
+
+/** @brief Wait for events.
+ *
+ * Blocks until at least one event is pending, then returns and clears the
+ * pending set.
+ *
+ * @return Bitmask of LOCK_EVT_* values.
+ */
+uint32_t lock_ctrl_wait(void);
+
+/** @brief Run the lock state machine for a set of events.
+ *
+ * Handles motor completion, lock detect changes and relock timeouts.
+ *
+ * @param events Bitmask returned by lock_ctrl_wait().
+ */
+void lock_ctrl_process(uint32_t events);
+
+/** @brief Restore the state kept across System OFF.
+ *
+ * Must be called before lock_ctrl_init(). An open lock starts checking for
+ * the shackle at once.
+ *
+ * @param state Controller state when the lock went to sleep.
+ * @param motor_fault Value of lock_ctrl_motor_fault() when the lock went
+ *		      to sleep.
+ * @param stats Controller statistics when the lock went to sleep.
+ */
+void lock_ctrl_restore(enum lock_state state, bool motor_fault,
+		       const struct lock_ctrl_stats *stats);
+
+/** @brief Open the shackle.
+ *
+ * Starts the motor and returns immediately. The controller moves from
+ * UNLOCKING to OPEN once the motor reports completion.
+ *
+ * @retval 0 If the motor was started.
+ * @retval -EBUSY If the motor is already running.
+ */
+int lock_ctrl_open(void);
+
+/** @brief Close the shackle.
+ *
+ * Starts the motor and returns immediately.
+ *
+ * @retval 0 If the motor was started.
+ * @retval -EBUSY If the motor is already running.
+ */
+int lock_ctrl_close(void);
+
+/** @brief Request a lock operation from another thread.
+ *
+ * The operation is executed by the controller thread. Blocks until the
+ * motor has finished or the timeout expires.
+ *
+ * @param req Operation to execute.
+ * @param timeout Maximum time to wait for completion.
+ *
+ * @retval 0 If the motor reached position.
+ * @retval -EBUSY If the motor was already running.
+ * @retval -ETIMEDOUT If a close ended with the shackle out.
+ * @retval -EAGAIN If the operation did not complete within @p timeout.
+ */
+int lock_ctrl_request(enum lock_req req, k_timeout_t timeout);
+
+/** @brief Select whether the lock closes itself after being opened.
+ *
+ * @param en Mirrors the auto close setting: when set, the shackle is only
+ *	     closed by an explicit close command.
+ */
+void lock_ctrl_set_auto_close(bool en);
+
+/** @brief Get the controller state. */
+enum lock_state lock_ctrl_get_state(void);
+
+/** @brief Check whether the last motor drive failed.
+ *
+ * Set when a drive ends with -ETIMEDOUT, cleared by the next drive that
+ * succeeds. Kept across System OFF.
+ */
+bool lock_ctrl_motor_fault(void);
+
+/** @brief Get the last known lock detect input level. */
+uint8_t lock_ctrl_lock_detect(void);
+
+/** @brief Get the last known USB detect input level. */
+uint8_t lock_ctrl_usb_detect(void);
+
+/** @brief Get a snapshot of the controller statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void lock_ctrl_get_stats(struct lock_ctrl_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* LOCK_CTRL_H_ */
@@ -25,63 +25,35 @@
 #include <zephyr/settings/settings.h>
 
 #include "led_buttons.h"
+#include "led_pattern.h"
 
-#include <zephyr/drivers/flash.h>
-#include <zephyr/storage/flash_map.h>
-#include <zephyr/fs/nvs.h>
 
 #include "adc.h"
+#include "lock_ctrl.h"
+#include "cmd.h"
+#include "conn_policy.h"
+#include "adv.h"
+#include "auth.h"
+#include "storage.h"
+#include "cred.h"
+#include "prov.h"
+#include "padlock_cfg.h"
+#include "audit.h"
+#include "diag.h"
+#include "deep_sleep.h"
 
-#define DEVICE_NAME             CONFIG_BT_DEVICE_NAME
-#define DEVICE_NAME_LEN         (sizeof(DEVICE_NAME) - 1)
 				
-#define RUN_LED_BLINK_INTERVAL  500
-
-#define KEY_ID 			1
-#define AUTO_CLOSE_ID	2
-extern bool notify_enabled;
 
 uint16_t battery_level = 0x00;
 uint32_t lock_status = 0x00;
-uint8_t pre_lock_status = 0x00;
-uint8_t cmd_status = 0x00;
-uint8_t timeout = 0x00;
-uint8_t bt_buf[8] = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
-uint8_t key_array[6] = {0x01, 0x02, 0x03, 0x04, 0x01, 0x02};
-uint8_t xor_array[6] = {0x73, 0x74, 0x65, 0x76, 0x65, 0x65};
 
 uint8_t input_idx = 0;
 uint8_t key_buf[6] = {0x00};
 
 uint32_t device_status = 0;
-uint32_t pre_device_status = 0;
-struct nvs_fs fs;
 
-uint8_t button_input = 0;
 uint8_t bt_connected = 0;
-uint8_t led_blink = 0;
-uint8_t scanned = 0;
-uint8_t scanned_timeout = 0;
-uint8_t charging = 0;
-uint8_t pressed_key = 0x00;
 uint8_t usb_detect = 0;
-uint8_t auto_closed_en = 0;
-
-#define KEY_LEN			(sizeof(key_array) - 2)
-#define NVS_PARTITION		storage_partition
-#define NVS_PARTITION_DEVICE	FIXED_PARTITION_DEVICE(NVS_PARTITION)
-#define NVS_PARTITION_OFFSET	FIXED_PARTITION_OFFSET(NVS_PARTITION)
-
-static const struct bt_data ad[] = {
-	BT_DATA_BYTES(BT_DATA_FLAGS, (BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR)),
-	BT_DATA(BT_DATA_NAME_COMPLETE, DEVICE_NAME, DEVICE_NAME_LEN),
-};
-
-static const struct bt_data sd[] = {
-	BT_DATA_BYTES(BT_DATA_UUID128_ALL,
-		      0x84, 0xaa, 0x60, 0x74, 0x52, 0x8a, 0x8b, 0x86,
-		      0xd3, 0x4c, 0xb7, 0x1d, 0x1d, 0xdc, 0x53, 0x8d),
-};
 
 static void connected(struct bt_conn *conn, uint8_t err)
 {
@@ -90,12 +62,14 @@ static void connected(struct bt_conn *conn, uint8_t err)
 		return;
 	}
 	bt_connected = 1;
+	lock_ctrl_post(LOCK_EVT_CONN);
 }
 
 static void disconnected(struct bt_conn *conn, uint8_t reason)
 {
 	printk("Disconnected (reason %u)\n", reason);
 	bt_connected = 0;
+	lock_ctrl_post(LOCK_EVT_CONN);
 }
 
 #ifdef CONFIG_BT_LBS_SECURITY_ENABLED
@@ -174,9 +148,25 @@ static struct bt_conn_auth_cb conn_auth_callbacks;
 static struct bt_conn_auth_info_cb conn_auth_info_callbacks;
 #endif
 
-static void app_key_cb(uint8_t* buf, uint16_t len)
+static int app_key_cb(const uint8_t *buf, uint16_t len)
+{
+	conn_policy_activity();
+
+	return padlock_cmd_submit_frame(buf, len);
+}
+
+static int app_cmd_cb(const uint8_t *buf, uint16_t len)
 {
-	memcpy(bt_buf, buf, 8);
+	conn_policy_activity();
+
+	return padlock_cmd_submit_tlv(buf, len);
+}
+
+static int app_prov_cb(const uint8_t *buf, uint16_t len)
+{
+	conn_policy_activity();
+
+	return prov_write(buf, len);
 }
 
 static uint32_t app_status_cb(void)
@@ -186,101 +176,304 @@ static uint32_t app_status_cb(void)
 
 static struct bt_padlock_cb padlock_callbacs = {
 	.key_cb    = app_key_cb,
+	.cmd_cb    = app_cmd_cb,
+	.prov_cb   = app_prov_cb,
 	.status_cb = app_status_cb,
 };
 
-static int init_nvs(void){
-	int rc = 0;
-	struct flash_pages_info info;
+static bool master_key_match(const uint8_t *key)
+{
+	uint8_t master[PADLOCK_CFG_KEY_LEN];
 
-	fs.flash_device = NVS_PARTITION_DEVICE;
-	if (!device_is_ready(fs.flash_device)) {
-		printk("Flash device %s is not ready\n", fs.flash_device->name);
-		return -EINVAL;
-	}
-	fs.offset = NVS_PARTITION_OFFSET;
-	rc = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
-	if (rc) {
-		printk("Unable to get page info\n");
-		return  -EINVAL;
-	}
-	fs.sector_size = info.size;
-	fs.sector_count = 3U;
+	padlock_cfg_get(PADLOCK_CFG_KEY, master);
 
-	rc = nvs_mount(&fs);
-	if (rc) {
-		printk("Flash Init failed\n");
-		return  -EINVAL;
-	}
+	return cred_secret_equal(key, master, sizeof(master));
+}
 
-	return 0;
+static void pin_check(void)
+{
+	uint16_t user = AUDIT_USER_MASTER;
+
+	if (master_key_match(key_buf) ||
+	    !cred_lookup(CRED_TYPE_PIN, key_buf, sizeof(key_buf), &user)) {
+		if (!lock_ctrl_open()) {
+			audit_log(AUDIT_EVT_UNLOCK, AUDIT_SRC_KEYPAD, user, 0);
+		}
+	}
+	else{
+		audit_log(AUDIT_EVT_AUTH_FAIL, AUDIT_SRC_KEYPAD,
+			  AUDIT_USER_NONE, 0);
+		led_pattern_play(RED_LED1, &led_pattern_double_flash);
+	}
+	input_idx = 0;
+	memset(key_buf, 0x00, sizeof(key_buf));
 }
 
 void button_scan(void)
 {
-	if(button_input == 1)
-	{
-		user_set_led(BLUE_LED3, 1);
-		if(pressed_key == ENTER_BTN1){		
+	struct user_key_event evt;
+
+	/* Drain every key entered since the last wakeup. */
+	while (user_key_get(&evt)) {
+		user_flash_led(BLUE_LED3);
+		if (evt.key == ENTER_BTN1) {
 			input_idx = 0;
+			continue;
 		}
-		else{
-			key_buf[input_idx] = pressed_key;
-			input_idx = input_idx + 1;	
+
+		key_buf[input_idx] = evt.key;
+		input_idx = input_idx + 1;
+
+		if (input_idx == sizeof(key_buf)) {
+			pin_check();
 		}
-		button_input = 0;
 	}
+}
 
-	if (input_idx == 6){
-		if ((key_buf[0] = key_array[0]) && (key_buf[1] == key_array[1]) && (key_buf[2] == key_array[2]) && 
-			(key_buf[3] == key_array[3]) && (key_buf[4] == key_array[4]) && (key_buf[5] == key_array[5]))
-		{
-			user_open_lock();
-			cmd_status = 1;
-		}
-		else{
-			user_set_led(RED_LED1, 1);
-			k_sleep(K_MSEC(300));
-			user_set_led(RED_LED1, 0);
-		}
-		input_idx = 0;
-		button_input = 0;
-		key_buf[0] = 0x00;
-		key_buf[1] = 0x00;
-		key_buf[2] = 0x00;
-		key_buf[3] = 0x00;
-		key_buf[4] = 0x00; 
-		key_buf[5] = 0x00;	
+static bool key_match(const uint8_t *key, uint16_t *user)
+{
+	*user = AUDIT_USER_MASTER;
+
+	return master_key_match(key) ||
+	       !cred_lookup(CRED_TYPE_BLE_KEY, key, PADLOCK_CFG_KEY_LEN, user);
+}
+
+static enum padlock_cmd_status lock_result_to_status(int err)
+{
+	switch (err) {
+	case 0:
+		return PADLOCK_CMD_STATUS_OK;
+	case -EBUSY:
+		return PADLOCK_CMD_STATUS_BUSY;
+	case -ETIMEDOUT:
+		return PADLOCK_CMD_STATUS_MOTOR_TIMEOUT;
+	default:
+		return PADLOCK_CMD_STATUS_TIMEOUT;
+	}
+}
+
+/* Operation handlers, run in the command worker thread. */
+static enum padlock_cmd_status app_cmd_auth(const struct padlock_cmd *cmd,
+					    uint16_t *user,
+					    struct net_buf_simple *rsp)
+{
+	if (!key_match(cmd->data, user)) {
+		audit_log(AUDIT_EVT_AUTH_FAIL, AUDIT_SRC_BLE,
+			  AUDIT_USER_NONE, 0);
+		user_flash_led(RED_LED1);
+		return PADLOCK_CMD_STATUS_AUTH_FAILED;
+	}
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static enum padlock_cmd_status app_cmd_unlock(const struct padlock_cmd *cmd,
+					      uint16_t *user,
+					      struct net_buf_simple *rsp)
+{
+	int err;
+
+	err = lock_ctrl_request(LOCK_REQ_OPEN,
+		K_MSEC(CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS + MSEC_PER_SEC));
+	if (!err) {
+		audit_log(AUDIT_EVT_UNLOCK, AUDIT_SRC_BLE, *user, 0);
+	}
+
+	return lock_result_to_status(err);
+}
+
+static enum padlock_cmd_status app_cmd_lock(const struct padlock_cmd *cmd,
+					    uint16_t *user,
+					    struct net_buf_simple *rsp)
+{
+	int err;
+
+	if (!padlock_cfg_auto_close()) {
+		return PADLOCK_CMD_STATUS_NOT_ALLOWED;
+	}
+
+	err = lock_ctrl_request(LOCK_REQ_CLOSE,
+		K_MSEC(CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS + MSEC_PER_SEC));
+
+	return lock_result_to_status(err);
+}
+
+static enum padlock_cmd_status app_cmd_key_update(const struct padlock_cmd *cmd,
+						  uint16_t *user,
+						  struct net_buf_simple *rsp)
+{
+	if (padlock_cfg_set(PADLOCK_CFG_KEY, cmd->data)) {
+		user_flash_led(RED_LED1);
+		return PADLOCK_CMD_STATUS_STORAGE_ERROR;
+	}
+
+	user_flash_led(BLUE_LED3);
+	auth_set_key(cmd->data, PADLOCK_CFG_KEY_LEN);
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static enum padlock_cmd_status app_cmd_auto_close(const struct padlock_cmd *cmd,
+						  uint16_t *user,
+						  struct net_buf_simple *rsp)
+{
+	padlock_cfg_set_auto_close(cmd->data[0]);
+	lock_ctrl_set_auto_close(padlock_cfg_auto_close());
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static enum padlock_cmd_status app_cmd_read_status(const struct padlock_cmd *cmd,
+						   uint16_t *user,
+						   struct net_buf_simple *rsp)
+{
+	net_buf_simple_add_le32(rsp, device_status);
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static enum padlock_cmd_status app_cmd_cred_revoke(const struct padlock_cmd *cmd,
+						   uint16_t *user,
+						   struct net_buf_simple *rsp)
+{
+	int revoked = cred_revoke_user(sys_get_le16(cmd->data));
+
+	if (revoked < 0) {
+		return PADLOCK_CMD_STATUS_STORAGE_ERROR;
+	}
+
+	net_buf_simple_add_u8(rsp, revoked);
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static enum padlock_cmd_status app_cmd_clock_set(const struct padlock_cmd *cmd,
+						 uint16_t *user,
+						 struct net_buf_simple *rsp)
+{
+	cred_clock_set(sys_get_le32(cmd->data));
+	audit_log(AUDIT_EVT_CLOCK_SET, AUDIT_SRC_BLE, *user, 0);
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static const struct padlock_cmd_handler app_cmd_handlers[] = {
+	{ PADLOCK_CMD_AUTH,        app_cmd_auth },
+	{ PADLOCK_CMD_UNLOCK,      app_cmd_unlock },
+	{ PADLOCK_CMD_LOCK,        app_cmd_lock },
+	{ PADLOCK_CMD_KEY_UPDATE,  app_cmd_key_update },
+	{ PADLOCK_CMD_AUTO_CLOSE,  app_cmd_auto_close },
+	{ PADLOCK_CMD_READ_STATUS, app_cmd_read_status },
+	{ PADLOCK_CMD_CRED_REVOKE, app_cmd_cred_revoke },
+	{ PADLOCK_CMD_CLOCK_SET,   app_cmd_clock_set },
+};
+
+static void battery_changed(int batt_mV)
+{
+	lock_ctrl_post(LOCK_EVT_BATTERY);
+}
+
+static void status_update(void)
+{
+	// update the lock status
+	int batt_mV = battery_level_mv();
+
+	if (batt_mV > 0) {
+		battery_level = batt_mV;
+	}
+
+	device_status = (lock_status & 0x0000FFFF) + (uint32_t)(battery_level << 16);
+
+	(void)bt_padlock_status_update(device_status);
+}
+
+static void beacon_update(void)
+{
+	struct adv_beacon beacon = {
+		.state = lock_ctrl_get_state(),
+	};
+	int batt_mV = battery_level_mv();
+
+	if (batt_mV > 0) {
+		beacon.battery = (battery_mv_to_pptt(batt_mV) + 500) / 1000;
+	}
+
+	if (lock_status) {
+		beacon.flags |= ADV_BEACON_F_SHACKLE_IN;
+	} else if (beacon.state == LOCK_STATE_LOCKED) {
+		beacon.flags |= ADV_BEACON_F_TAMPER;
+	}
+	if (lock_ctrl_motor_fault()) {
+		beacon.flags |= ADV_BEACON_F_MOTOR_FAULT;
+	}
+	if (usb_detect) {
+		beacon.flags |= ADV_BEACON_F_CHARGING;
 	}
 
-	lock_status =  get_lock_status();
+	adv_beacon_update(&beacon);
+}
+
+/* The white LED is steady while charging and blinks once the battery is
+ * full. The blink is played by the PWM, so it needs no service tick.
+ */
+static void charge_update(void)
+{
+	static const struct led_pattern *shown;
+	const struct led_pattern *pattern = NULL;
+	int batt_mV = battery_level_mv();
+
+	if (batt_mV > 0) {
+		battery_level = batt_mV;
+	}
+
+	if (usb_detect && (battery_level > 0x1060)) {
+		pattern = &led_pattern_blink;
+	}
+
+	user_set_led(WHITE_LED4, usb_detect && !pattern);
+
+	if (pattern == shown) {
+		return;
+	}
+	shown = pattern;
+
+	if (pattern) {
+		led_pattern_play(WHITE_LED4, pattern);
+	} else {
+		led_pattern_stop(WHITE_LED4);
+	}
 }
 
 int main(void)
 {
+	uint8_t key[PADLOCK_CFG_KEY_LEN];
 	int err;
 
-	err = init_nvs();	
+	err = storage_init();	
 	err = battery_setup();
 	err = battery_measure_enable(true);
-	// read the KEY
-	err = nvs_read(&fs, KEY_ID, &key_array, sizeof(key_array));
-	if (err > 0) { /* item was found, show it */
-		printk("Id: %d, Address: %s\n", KEY_ID, key_array);
-	} else   {/* item was not found, add it */
-		(void)nvs_write(&fs, KEY_ID, &key_array, strlen(key_array));
-	}
-
-	err = nvs_read(&fs, AUTO_CLOSE_ID, &auto_closed_en, sizeof(auto_closed_en));
-	if (err > 0) { /* item was found, show it */
-		printk("Id: %d, Address: %s\n", AUTO_CLOSE_ID, auto_closed_en);
-	} else   {/* item was not found, add it */
-		(void)nvs_write(&fs, AUTO_CLOSE_ID, &auto_closed_en, strlen(auto_closed_en));
+	err = battery_service_init(battery_changed);
+	padlock_cfg_init();
+	padlock_cfg_get(PADLOCK_CFG_KEY, key);
+	auth_set_key(key, sizeof(key));
+
+	err = cred_init();
+	if (err < 0) {
+		printk("Credential store init failed (err %d)\n", err);
 	}
+	prov_init();
+	audit_init();
 
 	user_leds_init();
 	user_buttons_init();
 
+	if (deep_sleep_init()) {
+		printk("Woke up from System OFF\n");
+	}
+	lock_ctrl_set_auto_close(padlock_cfg_auto_close());
+	lock_ctrl_init();
+	padlock_cmd_init(app_cmd_handlers, ARRAY_SIZE(app_cmd_handlers));
+
 	if (IS_ENABLED(CONFIG_BT_LBS_SECURITY_ENABLED)) {
 		err = bt_conn_auth_cb_register(&conn_auth_callbacks);
 		if (err) {
@@ -313,151 +506,60 @@ int main(void)
 		return 0;
 	}
 
-	err = bt_le_adv_start(BT_LE_ADV_CONN, ad, ARRAY_SIZE(ad),
-			      sd, ARRAY_SIZE(sd));
+	err = diag_init();
 	if (err) {
-		printk("Advertising failed to start (err %d)\n", err);
-		return 0;
+		printk("Failed to register diagnostics channel (err %d)\n", err);
 	}
 
-	printk("Advertising successfully started\n");
+	adv_init();
+	deep_sleep_ready();
+
+	usb_detect = lock_ctrl_usb_detect();
+	charge_update();
 
-	pre_lock_status = get_lock_status();
-	
 	for (;;) {
+		/* Sleep until an input source has something to report. */
+		uint32_t events = lock_ctrl_wait();
+
+		if (events & ~LOCK_EVT_BATTERY) {
+			deep_sleep_activity();
+		}
 
 		// process the user commands
+		if (events & LOCK_EVT_KEYPAD) {
+			adv_kick();
+			button_scan();
+		}
 
-		// If opening command ...
-		button_scan();
-
-		if(bt_connected){
-			if((bt_buf[0] == 0x55) && (bt_buf[7] == 0xAA))
-			{
-				if ((bt_buf[1] == key_array[0]) && (bt_buf[2] == key_array[1]) && (bt_buf[3] == key_array[2]) && 
-					(bt_buf[4] == key_array[3]) && (bt_buf[5] == key_array[4]) && (bt_buf[6] == key_array[5]))
-				{
-					user_open_lock();
-					cmd_status = 1;
-				}
-				else{
-					user_set_led(RED_LED1, 1);
-				}
-				bt_buf[0] = 0x00;
-				bt_buf[1] = 0x00;
-				bt_buf[2] = 0x00;
-				bt_buf[3] = 0x00;
-				bt_buf[4] = 0x00;
-				bt_buf[5] = 0x00;
-				bt_buf[6] = 0x00;
-				bt_buf[7] = 0x00;
-			}
-			//If updating the key...
-			else if((bt_buf[0] == 0x55) && (bt_buf[7] == 0xBB)){
-
-				bt_buf[1] = bt_buf[1] ^ xor_array[0];
-				bt_buf[2] = bt_buf[2] ^ xor_array[1];
-				bt_buf[3] = bt_buf[3] ^ xor_array[2];
-				bt_buf[4] = bt_buf[4] ^ xor_array[3];
-				bt_buf[5] = bt_buf[5] ^ xor_array[4];
-				bt_buf[6] = bt_buf[6] ^ xor_array[5];
-
-				err = nvs_write(&fs, KEY_ID, &bt_buf[1], KEY_LEN);
-
-				if((err == KEY_LEN) || (err == 0))
-				{	
-					user_set_led(BLUE_LED3, 1);
-					key_array[0] = bt_buf[1];
-					key_array[1] = bt_buf[2];
-					key_array[2] = bt_buf[3];
-					key_array[3] = bt_buf[4];
-					key_array[4] = bt_buf[5];
-					key_array[5] = bt_buf[6];
-				}
-				else{
-					user_set_led(RED_LED1, 1);
-				}
-				bt_buf[0] = 0x00;
-				bt_buf[1] = 0x00;
-				bt_buf[2] = 0x00;
-				bt_buf[3] = 0x00;
-				bt_buf[4] = 0x00;
-				bt_buf[5] = 0x00;
-				bt_buf[6] = 0x00;
-				bt_buf[7] = 0x00;
-			}
-			else if ((bt_buf[0] == 0x55) && (bt_buf[7] == 0xCC)){
-				auto_closed_en = bt_buf[6];
+		lock_ctrl_process(events);
+		lock_status = lock_ctrl_lock_detect();
 
-				(void)nvs_write(&fs, AUTO_CLOSE_ID, &auto_closed_en, strlen(auto_closed_en));
-			}
-			else if((bt_buf[0] == 0x55) && (bt_buf[7] == 0xAB) && (auto_closed_en == 1))
-			{
-				if ((bt_buf[1] == key_array[0]) && (bt_buf[2] == key_array[1]) && (bt_buf[3] == key_array[2]) && 
-					(bt_buf[4] == key_array[3]) && (bt_buf[5] == key_array[4]) && (bt_buf[6] == key_array[5]))
-				{
-					user_close_lock();
-					cmd_status = 0;
-				}
-				else{
-					user_set_led(RED_LED1, 1);
-				}
-				bt_buf[0] = 0x00;
-				bt_buf[1] = 0x00;
-				bt_buf[2] = 0x00;
-				bt_buf[3] = 0x00;
-				bt_buf[4] = 0x00;
-				bt_buf[5] = 0x00;
-				bt_buf[6] = 0x00;
-				bt_buf[7] = 0x00;
+		//check charging
+		if (events & LOCK_EVT_USB_DETECT) {
+			usb_detect = lock_ctrl_usb_detect();
+			battery_sample_request();
+			if (usb_detect) {
+				adv_kick();
 			}
-			
+		}
 
-			// update the lock status
-			battery_level = battery_sample() * 1.403;
+		if (events & (LOCK_EVT_USB_DETECT | LOCK_EVT_BATTERY)) {
+			charge_update();
+		}
 
-			device_status = (lock_status & 0x0000FFFF) + (uint32_t)(battery_level << 16);
+		if (events & LOCK_EVT_BATTERY) {
+			int batt_mV = battery_level_mv();
 
-			if ((notify_enabled == true) && (pre_device_status != device_status)){
-				bt_padlock_send_button_state(device_status);
+			if (batt_mV > 0) {
+				(void)bt_padlock_battery_update(
+					battery_mv_to_pptt(batt_mV));
 			}
-			pre_device_status = device_status;
-		}
-		
-		// if open command...
-		if(cmd_status == 1){ // 10 second timeout to open a lock 
-			timeout = timeout + 1;
-			if(timeout > 5){
-				timeout = 0;
-				if((lock_status == 1) && (auto_closed_en == 0)){ // after 5s, close a lock again
-					user_close_lock();
-					cmd_status = 0;
-				}
-			}
-		}
-		if((timeout == 0) && (cmd_status == 1) && (auto_closed_en == 0) && (pre_lock_status == 0) && (lock_status == 1)){ // if lock is detected, run a motor
-			user_close_lock();
-			cmd_status = 0;
 		}
 
-		pre_lock_status = lock_status;		
-		//check charging
-		
-		usb_detect = get_usb_status();
-		if( usb_detect == 1){
-			if (bt_connected == 0){
-				battery_level = battery_sample() * 1.403;
-			}
-			if(battery_level > 0x1060){
-				user_set_led(WHITE_LED4, (led_blink % 2));
-			}
-			else{
-				user_set_led(WHITE_LED4, 1);
-			}
-			led_blink++;
+		if (bt_connected) {
+			status_update();
 		}
 
-		k_sleep(K_MSEC(RUN_LED_BLINK_INTERVAL));
-		user_set_led_all_off();
-	}	
-}	
+		beacon_update();
+	}
+}
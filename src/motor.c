@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/printk.h>
+#include <errno.h>
+
+#include "motor.h"
+#include "led_buttons.h"
+#include "motor_hw.h"
+
+enum {
+	MOTOR_IDLE,
+	MOTOR_RUNNING,
+	MOTOR_STOPPING,
+};
+
+static atomic_t motor_state = ATOMIC_INIT(MOTOR_IDLE);
+static motor_done_cb_t motor_done_cb;
+static enum motor_dir drive_dir;
+static uint32_t drive_start;
+static uint32_t drive_ms;
+static uint32_t drive_us;
+static bool drive_detect_stop;
+/* The pulse is timed by hardware, see motor_hw.h. */
+static bool hw_pulse;
+static struct motor_stats stats;
+
+static void motor_done_work_handler(struct k_work *work);
+static void motor_timeout_work_handler(struct k_work *work);
+
+static K_WORK_DEFINE(motor_done_work, motor_done_work_handler);
+static K_WORK_DELAYABLE_DEFINE(motor_timeout_work, motor_timeout_work_handler);
+
+/* Cut motor power. Returns false if the drive was already stopped. */
+static bool motor_stop(bool detect_stop)
+{
+	if (!atomic_cas(&motor_state, MOTOR_RUNNING, MOTOR_STOPPING)) {
+		return false;
+	}
+
+	if (hw_pulse) {
+		drive_us = motor_hw_stop();
+		drive_ms = drive_us / USEC_PER_MSEC;
+	} else {
+		user_motor_drive(0, 0);
+		drive_ms = k_uptime_get_32() - drive_start;
+		drive_us = drive_ms * USEC_PER_MSEC;
+	}
+	drive_detect_stop = detect_stop;
+
+	return true;
+}
+
+/* An open is done when the shackle springs out, or after the full pulse
+ * if it stays in: the latch is released either way. A close always runs
+ * the full pulse, as the shackle is already in, and has only reached
+ * position if the shackle is still in afterwards.
+ */
+static int drive_result(void)
+{
+	if (drive_detect_stop) {
+		stats.detect_stops++;
+		return 0;
+	}
+
+	if ((drive_dir == MOTOR_DIR_CLOSE) && !get_lock_status()) {
+		stats.timeouts++;
+		return -ETIMEDOUT;
+	}
+
+	stats.full_drives++;
+	return 0;
+}
+
+static void motor_done_work_handler(struct k_work *work)
+{
+	int result;
+
+	(void)k_work_cancel_delayable(&motor_timeout_work);
+
+	user_set_led(GREEN_LED2, 0);
+
+	stats.last_drive_ms = drive_ms;
+	stats.last_drive_us = drive_us;
+	stats.total_drive_ms += drive_ms;
+	result = drive_result();
+
+	atomic_set(&motor_state, MOTOR_IDLE);
+
+	if (motor_done_cb) {
+		motor_done_cb(drive_dir, result, drive_ms);
+	}
+}
+
+static void motor_timeout_work_handler(struct k_work *work)
+{
+	if (motor_stop(false)) {
+		motor_done_work_handler(&motor_done_work);
+	}
+}
+
+/* The hardware has already released the bridge when this runs. */
+static void motor_hw_timeout(void)
+{
+	if (motor_stop(false)) {
+		k_work_submit(&motor_done_work);
+	}
+}
+
+void motor_init(motor_done_cb_t done_cb)
+{
+	motor_done_cb = done_cb;
+
+	if (IS_ENABLED(CONFIG_PADLOCK_MOTOR_HW)) {
+		int err = motor_hw_init(motor_hw_timeout);
+
+		/* Fall back to the GPIO drive and its software stall guard. */
+		if (err) {
+			printk("Motor pulse hardware init failed (err %d)\n",
+			       err);
+		}
+		hw_pulse = !err;
+	}
+}
+
+int motor_start(enum motor_dir dir)
+{
+	if (!atomic_cas(&motor_state, MOTOR_IDLE, MOTOR_RUNNING)) {
+		return -EBUSY;
+	}
+
+	drive_dir = dir;
+	drive_start = k_uptime_get_32();
+
+	user_set_led(GREEN_LED2, 1);
+
+	if (hw_pulse) {
+		/* The stall guard is part of the hardware pulse. */
+		motor_hw_start(dir);
+		return 0;
+	}
+
+	if (dir == MOTOR_DIR_OPEN) {
+		user_motor_drive(0, 1);
+	} else {
+		user_motor_drive(1, 0);
+	}
+
+	/* Stall guard: never drive longer than the configured maximum. */
+	k_work_schedule(&motor_timeout_work,
+			K_MSEC(CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS));
+
+	return 0;
+}
+
+void motor_on_lock_detect(int level)
+{
+	/* Only an open finishes early, when the shackle springs out. Ignore
+	 * contact bounce right after the motor starts.
+	 */
+	if ((atomic_get(&motor_state) != MOTOR_RUNNING) ||
+	    (drive_dir != MOTOR_DIR_OPEN) || level ||
+	    ((k_uptime_get_32() - drive_start) <
+	     CONFIG_PADLOCK_MOTOR_MIN_DRIVE_MS)) {
+		return;
+	}
+
+	if (motor_stop(true)) {
+		k_work_submit(&motor_done_work);
+	}
+}
+
+void motor_get_stats(struct motor_stats *out)
+{
+	*out = stats;
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MOTOR_H_
+#define MOTOR_H_
+
+/**@file
+ * @defgroup motor Shackle motor actuator
+ * @{
+ * @brief Non-blocking driver for the shackle motor H-bridge.
+ *
+ * A drive is started with motor_start() and is a pulse of at most
+ * CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS. An open ends early when the lock
+ * detect input reports the shackle out. A close always runs the full
+ * pulse. The completion callback reports whether the drive reached its
+ * position and how long the motor was actually powered.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Motor drive direction. */
+enum motor_dir {
+	/** Release the shackle. */
+	MOTOR_DIR_OPEN,
+	/** Lock the shackle. */
+	MOTOR_DIR_CLOSE,
+};
+
+/** @brief Callback type for when a drive has finished.
+ *
+ * Called from the system work queue.
+ *
+ * @param dir Direction of the finished drive.
+ * @param result 0 if the drive reached its position, -ETIMEDOUT if a
+ *		 close ended with the shackle out.
+ * @param drive_ms Time the motor was powered, in milliseconds.
+ */
+typedef void (*motor_done_cb_t)(enum motor_dir dir, int result,
+				uint32_t drive_ms);
+
+/** @brief Motor statistics. */
+struct motor_stats {
+	/** Duration of the last drive, in milliseconds. */
+	uint32_t last_drive_ms;
+	/** Duration of the last drive, in microseconds. */
+	uint32_t last_drive_us;
+	/** Accumulated drive time, in milliseconds. */
+	uint32_t total_drive_ms;
+	/** Drives stopped early by the lock detect input. */
+	uint32_t detect_stops;
+	/** Drives that ran the full pulse and reached position. */
+	uint32_t full_drives;
+	/** Closes that ended with the shackle out. */
+	uint32_t timeouts;
+};
+
+/** @brief Initialize the motor actuator.
+ *
+ * @param done_cb Called each time a drive has finished.
+ */
+void motor_init(motor_done_cb_t done_cb);
+
+/** @brief Start driving the motor.
+ *
+ * Returns immediately; completion is reported through the callback
+ * passed to motor_init().
+ *
+ * @param dir Direction to drive.
+ *
+ * @retval 0 If the drive was started.
+ * @retval -EBUSY If the motor is already running.
+ */
+int motor_start(enum motor_dir dir);
+
+/** @brief Notify the actuator that the lock detect input changed.
+ *
+ * Called from the lock detect interrupt. Cuts motor power if an open is
+ * in progress and the shackle is out.
+ *
+ * @param level Level of the lock detect input, 1 with the shackle in.
+ */
+void motor_on_lock_detect(int level);
+
+/** @brief Get a snapshot of the motor statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void motor_get_stats(struct motor_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* MOTOR_H_ */
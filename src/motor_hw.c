@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <soc.h>
+#include <nrfx_gpiote.h>
+#include <nrfx_ppi.h>
+#include <nrfx_timer.h>
+#include <errno.h>
+
+#include "motor_hw.h"
+
+#define PIN_AIN			NRF_DT_GPIOS_TO_PSEL(DT_NODELABEL(ain_gpio), gpios)
+#define PIN_BIN			NRF_DT_GPIOS_TO_PSEL(DT_NODELABEL(bin_gpio), gpios)
+
+#define DEAD_TIME_US		CONFIG_PADLOCK_MOTOR_DEAD_TIME_US
+#define SOFT_START_US		(CONFIG_PADLOCK_MOTOR_SOFT_START_MS * USEC_PER_MSEC)
+#define MAX_DRIVE_US		(CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS * USEC_PER_MSEC)
+#define SOFT_START		(SOFT_START_US > 0)
+
+/* Soft start chopper: 20 kHz at 16 MHz. */
+#define CHOP_PERIOD_TICKS	800
+#define CHOP_ON_TICKS		(CHOP_PERIOD_TICKS * \
+				 CONFIG_PADLOCK_MOTOR_SOFT_START_DUTY / 100)
+
+/* Pulse timer compare channels. */
+#define CC_DRIVE		NRF_TIMER_CC_CHANNEL0
+#define CC_FULL			NRF_TIMER_CC_CHANNEL1
+#define CC_LIMIT		NRF_TIMER_CC_CHANNEL2
+#define CC_CAPTURE		NRF_TIMER_CC_CHANNEL3
+
+/* Chopper compare channels. */
+#define CC_CHOP_OFF		NRF_TIMER_CC_CHANNEL0
+#define CC_CHOP_ON		NRF_TIMER_CC_CHANNEL1
+
+BUILD_ASSERT(SOFT_START_US < MAX_DRIVE_US,
+	     "Soft start longer than the maximum drive time");
+
+enum {
+	PPI_DRIVE,
+	PPI_FULL,
+	PPI_LIMIT,
+	PPI_CHOP_OFF,
+	PPI_CHOP_ON,
+	PPI_COUNT,
+};
+
+static const nrfx_timer_t pulse_timer = NRFX_TIMER_INSTANCE(1);
+static const nrfx_timer_t chop_timer = NRFX_TIMER_INSTANCE(2);
+
+/* Bridge input driven for each direction. */
+static const uint32_t drive_pin[] = {
+	[MOTOR_DIR_OPEN] = PIN_BIN,
+	[MOTOR_DIR_CLOSE] = PIN_AIN,
+};
+
+static nrf_ppi_channel_t ppi[PPI_COUNT];
+static motor_hw_timeout_cb_t timeout_cb;
+
+static void pulse_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+	if ((event_type == NRF_TIMER_EVENT_COMPARE2) && timeout_cb) {
+		timeout_cb();
+	}
+}
+
+/* The chopper raises no interrupts. */
+static void chop_timer_handler(nrf_timer_event_t event_type, void *context)
+{
+}
+
+static int output_init(uint32_t pin, uint8_t channel)
+{
+	nrfx_gpiote_output_config_t config = NRFX_GPIOTE_DEFAULT_OUTPUT_CONFIG;
+	nrfx_gpiote_task_config_t task = {
+		.task_ch = channel,
+		.polarity = NRF_GPIOTE_POLARITY_TOGGLE,
+		.init_val = NRF_GPIOTE_INITIAL_VALUE_LOW,
+	};
+
+	if (nrfx_gpiote_output_configure(pin, &config, &task) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	nrfx_gpiote_out_task_enable(pin);
+
+	return 0;
+}
+
+static uint32_t timer_event(const nrfx_timer_t *timer, uint32_t cc)
+{
+	return nrfx_timer_compare_event_address_get(timer, cc);
+}
+
+static void release(void)
+{
+	nrfx_gpiote_clr_task_trigger(PIN_AIN);
+	nrfx_gpiote_clr_task_trigger(PIN_BIN);
+}
+
+int motor_hw_init(motor_hw_timeout_cb_t cb)
+{
+	nrfx_timer_config_t config = NRFX_TIMER_DEFAULT_CONFIG;
+	uint8_t gpiote_ch[2];
+	uint32_t chop_stop;
+	int err;
+
+	timeout_cb = cb;
+
+	config.frequency = NRF_TIMER_FREQ_1MHz;
+	config.bit_width = NRF_TIMER_BIT_WIDTH_32;
+	if (nrfx_timer_init(&pulse_timer, &config,
+			    pulse_timer_handler) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	config.frequency = NRF_TIMER_FREQ_16MHz;
+	config.bit_width = NRF_TIMER_BIT_WIDTH_16;
+	if (nrfx_timer_init(&chop_timer, &config,
+			    chop_timer_handler) != NRFX_SUCCESS) {
+		return -EIO;
+	}
+
+	IRQ_CONNECT(DT_IRQN(DT_NODELABEL(timer1)),
+		    DT_IRQ(DT_NODELABEL(timer1), priority),
+		    nrfx_isr, nrfx_timer_1_irq_handler, 0);
+
+	/* Everything is allocated before the pins are handed to GPIOTE, so
+	 * a failure leaves them as plain GPIOs for the software drive.
+	 */
+	for (size_t i = 0; i < ARRAY_SIZE(gpiote_ch); i++) {
+		if (nrfx_gpiote_channel_alloc(&gpiote_ch[i]) != NRFX_SUCCESS) {
+			return -ENOMEM;
+		}
+	}
+
+	for (size_t i = 0; i < PPI_COUNT; i++) {
+		if (nrfx_ppi_channel_alloc(&ppi[i]) != NRFX_SUCCESS) {
+			return -ENOMEM;
+		}
+	}
+
+	err = output_init(PIN_AIN, gpiote_ch[0]);
+	if (!err) {
+		err = output_init(PIN_BIN, gpiote_ch[1]);
+	}
+	if (err) {
+		return err;
+	}
+
+	/* Compare values and shorts are the same for every pulse. The
+	 * limit stops the pulse timer, so the only interrupt of a pulse
+	 * comes from there.
+	 */
+	nrfx_timer_compare(&pulse_timer, CC_DRIVE, DEAD_TIME_US, false);
+	nrfx_timer_compare(&pulse_timer, CC_FULL,
+			   DEAD_TIME_US + SOFT_START_US, false);
+	nrfx_timer_extended_compare(&pulse_timer, CC_LIMIT,
+				    DEAD_TIME_US + MAX_DRIVE_US,
+				    NRF_TIMER_SHORT_COMPARE2_STOP_MASK, true);
+
+	nrfx_timer_compare(&chop_timer, CC_CHOP_OFF, CHOP_ON_TICKS, false);
+	nrfx_timer_extended_compare(&chop_timer, CC_CHOP_ON, CHOP_PERIOD_TICKS,
+				    NRF_TIMER_SHORT_COMPARE1_CLEAR_MASK, false);
+
+	chop_stop = nrfx_timer_task_address_get(&chop_timer,
+						NRF_TIMER_TASK_STOP);
+
+	if (SOFT_START) {
+		nrfx_ppi_channel_fork_assign(ppi[PPI_DRIVE],
+			nrfx_timer_task_address_get(&chop_timer,
+						    NRF_TIMER_TASK_START));
+		nrfx_ppi_channel_fork_assign(ppi[PPI_FULL], chop_stop);
+	}
+	nrfx_ppi_channel_fork_assign(ppi[PPI_LIMIT], chop_stop);
+
+	release();
+
+	return 0;
+}
+
+void motor_hw_start(enum motor_dir dir)
+{
+	uint32_t pin = drive_pin[dir];
+	uint32_t set = nrfx_gpiote_set_task_addr_get(pin);
+	uint32_t clr = nrfx_gpiote_clr_task_addr_get(pin);
+
+	/* Both inputs are released here, and the dead time passes before
+	 * the selected one is driven.
+	 */
+	release();
+
+	nrfx_timer_clear(&pulse_timer);
+	nrfx_timer_clear(&chop_timer);
+
+	nrfx_ppi_channel_assign(ppi[PPI_DRIVE],
+				timer_event(&pulse_timer, CC_DRIVE), set);
+	nrfx_ppi_channel_assign(ppi[PPI_LIMIT],
+				timer_event(&pulse_timer, CC_LIMIT), clr);
+	nrfx_ppi_channel_enable(ppi[PPI_DRIVE]);
+	nrfx_ppi_channel_enable(ppi[PPI_LIMIT]);
+
+	if (SOFT_START) {
+		nrfx_ppi_channel_assign(ppi[PPI_FULL],
+					timer_event(&pulse_timer, CC_FULL), set);
+		nrfx_ppi_channel_assign(ppi[PPI_CHOP_OFF],
+					timer_event(&chop_timer, CC_CHOP_OFF),
+					clr);
+		nrfx_ppi_channel_assign(ppi[PPI_CHOP_ON],
+					timer_event(&chop_timer, CC_CHOP_ON),
+					set);
+		nrfx_ppi_channel_enable(ppi[PPI_FULL]);
+		nrfx_ppi_channel_enable(ppi[PPI_CHOP_OFF]);
+		nrfx_ppi_channel_enable(ppi[PPI_CHOP_ON]);
+	}
+
+	nrfx_timer_enable(&pulse_timer);
+}
+
+uint32_t motor_hw_stop(void)
+{
+	uint32_t now = nrfx_timer_capture(&pulse_timer, CC_CAPTURE);
+
+	nrfx_timer_disable(&pulse_timer);
+	nrfx_timer_disable(&chop_timer);
+
+	for (size_t i = 0; i < PPI_COUNT; i++) {
+		(void)nrfx_ppi_channel_disable(ppi[i]);
+	}
+
+	release();
+
+	now = MIN(now, DEAD_TIME_US + MAX_DRIVE_US);
+
+	return (now > DEAD_TIME_US) ? (now - DEAD_TIME_US) : 0;
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef MOTOR_HW_H_
+#define MOTOR_HW_H_
+
+/**@file
+ * @defgroup motor_hw Hardware timed motor pulse
+ * @{
+ * @brief H-bridge drive pulse generated by TIMER, PPI and GPIOTE.
+ *
+ * Both bridge inputs are GPIOTE task outputs. Only the input of the
+ * selected direction is ever connected to a set task, so the two
+ * directions cannot overlap. TIMER1 times the whole pulse in
+ * microseconds:
+ *
+ * - CONFIG_PADLOCK_MOTOR_DEAD_TIME_US after the start, with both inputs
+ *   released, the drive begins.
+ * - For CONFIG_PADLOCK_MOTOR_SOFT_START_MS, TIMER2 chops the input at
+ *   20 kHz with CONFIG_PADLOCK_MOTOR_SOFT_START_DUTY percent on time to
+ *   limit the inrush current. Then the input stays on.
+ * - After CONFIG_PADLOCK_MOTOR_MAX_DRIVE_MS the input is released by
+ *   hardware, and the only interrupt of the pulse is raised.
+ */
+
+#include <zephyr/types.h>
+
+#include "motor.h"
+
+/** @brief Called from the TIMER1 interrupt when the maximum drive time
+ *	   has expired. The output is already released.
+ */
+typedef void (*motor_hw_timeout_cb_t)(void);
+
+/** @brief Allocate and connect the peripherals.
+ *
+ * If no GPIOTE or PPI channel is left, the bridge pins are not touched
+ * and can still be driven as GPIOs.
+ *
+ * @param timeout_cb Called when a pulse hits the maximum drive time.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int motor_hw_init(motor_hw_timeout_cb_t timeout_cb);
+
+/** @brief Start a drive pulse.
+ *
+ * @param dir Direction to drive.
+ */
+void motor_hw_start(enum motor_dir dir);
+
+/** @brief Release both inputs at once and stop the pulse timers.
+ *
+ * Safe to call from interrupts.
+ *
+ * @return Time the bridge was driven, in microseconds.
+ */
+uint32_t motor_hw_stop(void);
+
+/**
+ * @}
+ */
+
+#endif /* MOTOR_HW_H_ */
@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/atomic.h>
+#include <errno.h>
+#include <string.h>
+
+#include "padlock_cfg.h"
+#include "storage.h"
+
+#define CFG_VALUE_MAX		PADLOCK_CFG_KEY_LEN
+
+static uint8_t key_value[PADLOCK_CFG_KEY_LEN] = {
+	0x01, 0x02, 0x03, 0x04, 0x01, 0x02
+};
+static uint8_t auto_close_value;
+
+static const struct cfg_entry {
+	uint16_t storage_id;
+	uint8_t len;
+	/* Written through instead of waiting for the deferred flush. */
+	bool critical;
+	void *value;
+} cfg_table[] = {
+	[PADLOCK_CFG_KEY] = {
+		STORAGE_ID_KEY, sizeof(key_value), true, key_value
+	},
+	[PADLOCK_CFG_AUTO_CLOSE] = {
+		STORAGE_ID_AUTO_CLOSE, sizeof(auto_close_value), false,
+		&auto_close_value
+	},
+};
+
+BUILD_ASSERT(ARRAY_SIZE(cfg_table) == PADLOCK_CFG_COUNT,
+	     "Every setting needs a table entry");
+
+static K_MUTEX_DEFINE(cfg_lock);
+static ATOMIC_DEFINE(dirty, PADLOCK_CFG_COUNT);
+static struct padlock_cfg_stats stats;
+
+static void flush_work_fn(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_work_fn);
+
+void padlock_cfg_init(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(cfg_table); i++) {
+		const struct cfg_entry *e = &cfg_table[i];
+
+		/* Entries written before the full key length was stored are
+		 * shorter, the remaining bytes keep their default.
+		 */
+		(void)storage_read(e->storage_id, e->value, e->len);
+	}
+}
+
+void padlock_cfg_get(enum padlock_cfg_id id, void *value)
+{
+	const struct cfg_entry *e = &cfg_table[id];
+
+	k_mutex_lock(&cfg_lock, K_FOREVER);
+	memcpy(value, e->value, e->len);
+	k_mutex_unlock(&cfg_lock);
+}
+
+static int entry_write(enum padlock_cfg_id id)
+{
+	const struct cfg_entry *e = &cfg_table[id];
+	uint8_t value[CFG_VALUE_MAX];
+	ssize_t rc;
+
+	if (!atomic_test_and_clear_bit(dirty, id)) {
+		return 0;
+	}
+
+	k_mutex_lock(&cfg_lock, K_FOREVER);
+	memcpy(value, e->value, e->len);
+	k_mutex_unlock(&cfg_lock);
+
+	rc = storage_write(e->storage_id, value, e->len);
+	if (rc < 0) {
+		stats.write_errors++;
+		atomic_set_bit(dirty, id);
+		return -EIO;
+	}
+
+	stats.writes++;
+
+	return 0;
+}
+
+static void flush_work_fn(struct k_work *work)
+{
+	bool retry = false;
+
+	for (size_t id = 0; id < PADLOCK_CFG_COUNT; id++) {
+		if (entry_write(id)) {
+			retry = true;
+		}
+	}
+
+	if (retry) {
+		(void)storage_work_schedule(&flush_work,
+			K_MSEC(CONFIG_PADLOCK_CFG_FLUSH_DELAY_MS));
+	}
+}
+
+void padlock_cfg_flush(void)
+{
+	(void)storage_work_reschedule(&flush_work, K_NO_WAIT);
+}
+
+int padlock_cfg_set(enum padlock_cfg_id id, const void *value)
+{
+	const struct cfg_entry *e = &cfg_table[id];
+	uint8_t old[CFG_VALUE_MAX];
+	int err;
+
+	k_mutex_lock(&cfg_lock, K_FOREVER);
+
+	if (!memcmp(e->value, value, e->len)) {
+		k_mutex_unlock(&cfg_lock);
+		stats.writes_avoided++;
+		return 0;
+	}
+
+	memcpy(old, e->value, e->len);
+	memcpy(e->value, value, e->len);
+
+	k_mutex_unlock(&cfg_lock);
+
+	if (atomic_test_and_set_bit(dirty, id)) {
+		stats.writes_coalesced++;
+	}
+
+	if (e->critical) {
+		err = entry_write(id);
+		if (err) {
+			/* Never run with a key that is not in flash. */
+			k_mutex_lock(&cfg_lock, K_FOREVER);
+			memcpy(e->value, old, e->len);
+			k_mutex_unlock(&cfg_lock);
+			atomic_clear_bit(dirty, id);
+		}
+
+		return err;
+	}
+
+	/* Keeps an already scheduled flush, so a burst is written once. */
+	(void)storage_work_schedule(&flush_work,
+				    K_MSEC(CONFIG_PADLOCK_CFG_FLUSH_DELAY_MS));
+
+	return 0;
+}
+
+void padlock_cfg_get_stats(struct padlock_cfg_stats *out)
+{
+	*out = stats;
+}
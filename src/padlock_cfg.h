@@ -0,0 +1,107 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PADLOCK_CFG_H_
+#define PADLOCK_CFG_H_
+
+/**@file
+ * @defgroup padlock_cfg Padlock settings
+ * @{
+ * @brief Write-back cache of the persistent padlock settings.
+ *
+ * Settings are loaded once at boot and then served from RAM. A set with
+ * the current value does nothing. A changed value is marked dirty and
+ * written to flash by a deferred flush on the storage work queue, so
+ * several changes in a row cost a single write. Security critical
+ * settings are written through immediately instead.
+ */
+
+#include <zephyr/types.h>
+
+/** @brief Length of the shared key. */
+#define PADLOCK_CFG_KEY_LEN	6
+
+/** @brief Setting identifiers. */
+enum padlock_cfg_id {
+	/** Shared key, PADLOCK_CFG_KEY_LEN bytes, written through. */
+	PADLOCK_CFG_KEY,
+	/** Auto close setting, one byte. */
+	PADLOCK_CFG_AUTO_CLOSE,
+
+	PADLOCK_CFG_COUNT,
+};
+
+/** @brief Settings cache statistics. */
+struct padlock_cfg_stats {
+	/** Values written to flash. */
+	uint32_t writes;
+	/** Sets skipped because the value did not change. */
+	uint32_t writes_avoided;
+	/** Sets merged into a value that was already waiting for a flush. */
+	uint32_t writes_coalesced;
+	/** Flash writes that failed and were retried. */
+	uint32_t write_errors;
+};
+
+/** @brief Load all settings.
+ *
+ * Settings missing from flash keep their default. Must be called after
+ * storage_init().
+ */
+void padlock_cfg_init(void);
+
+/** @brief Read a setting from the cache.
+ *
+ * @param id Setting to read.
+ * @param[out] value Buffer large enough for the setting.
+ */
+void padlock_cfg_get(enum padlock_cfg_id id, void *value);
+
+/** @brief Change a setting.
+ *
+ * @param id Setting to change.
+ * @param value New value.
+ *
+ * @retval 0 If the value is unchanged, cached for a deferred flush, or
+ *	     written through.
+ * @retval -EIO If a write-through setting could not be written.
+ */
+int padlock_cfg_set(enum padlock_cfg_id id, const void *value);
+
+/** @brief Write all dirty settings without further delay.
+ *
+ * The write runs on the storage work queue, storage_work_drain() waits
+ * for it.
+ */
+void padlock_cfg_flush(void);
+
+/** @brief Get a snapshot of the cache statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void padlock_cfg_get_stats(struct padlock_cfg_stats *stats);
+
+/** @brief Get the auto close setting. */
+static inline bool padlock_cfg_auto_close(void)
+{
+	uint8_t value;
+
+	padlock_cfg_get(PADLOCK_CFG_AUTO_CLOSE, &value);
+
+	return value == 1;
+}
+
+/** @brief Change the auto close setting. */
+static inline void padlock_cfg_set_auto_close(uint8_t value)
+{
+	(void)padlock_cfg_set(PADLOCK_CFG_AUTO_CLOSE, &value);
+}
+
+/**
+ * @}
+ */
+
+#endif /* PADLOCK_CFG_H_ */
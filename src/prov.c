@@ -0,0 +1,446 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/sys/byteorder.h>
+#include <errno.h>
+#include <string.h>
+
+#include "prov.h"
+#include "auth.h"
+#include "ble.h"
+#include "cmd.h"
+#include "cred.h"
+#include "storage.h"
+
+#define PROV_OP_BEGIN		0x01
+#define PROV_OP_DATA		0x02
+#define PROV_OP_COMMIT		0x03
+#define PROV_OP_ABORT		0x04
+
+#define PROV_BEGIN_LEN		(4 + AUTH_MAC_LEN)
+#define PROV_DATA_HDR_LEN	3
+#define PROV_COMMIT_LEN		(1 + AUTH_MAC_LEN)
+
+#define PROV_STAGE_RECORDS	CONFIG_PADLOCK_PROV_STAGE_RECORDS
+#define PROV_JOURNAL_BLOCKS	DIV_ROUND_UP(CONFIG_PADLOCK_CRED_MAX, \
+					     PROV_STAGE_RECORDS)
+
+BUILD_ASSERT(PROV_JOURNAL_BLOCKS <
+	     (STORAGE_ID_PROV_COMMIT - STORAGE_ID_PROV_BASE),
+	     "Provisioning journal overlaps the commit marker");
+BUILD_ASSERT(PROV_JOURNAL_BLOCKS <= UINT8_MAX,
+	     "Too many provisioning journal blocks");
+
+enum prov_state {
+	PROV_STATE_IDLE,
+	PROV_STATE_RECEIVING,
+	PROV_STATE_COMMITTING,
+};
+
+/* Written to flash once the journal is complete and verified. */
+struct prov_marker {
+	uint16_t count;
+	uint8_t flags;
+	uint8_t blocks;
+} __packed;
+
+struct prov_stage {
+	uint8_t count;
+	struct cred_record rec[PROV_STAGE_RECORDS];
+};
+
+/* One buffer fills from the BLE receive thread while the other one is
+ * written to the journal on the storage work queue.
+ */
+static struct prov_stage stage[2];
+static uint8_t fill;
+static uint8_t spill;
+static atomic_t spill_busy;
+static atomic_t spill_error;
+
+static atomic_t state;
+static struct prov_marker marker;
+/* E(K, nonce) of the BEGIN nonce, the journal MAC is bound to it. */
+static uint8_t begin_pad[AUTH_PAD_LEN];
+static uint8_t commit_mac[AUTH_MAC_LEN];
+static uint16_t received;
+static uint8_t journal_blocks;
+static uint32_t begin_time;
+/* A committed batch is still in flash and must be applied first. */
+static bool replay_pending;
+
+static struct prov_stats stats;
+
+static void prov_notify(uint8_t op, uint8_t status)
+{
+	uint8_t rsp[4] = { op, status };
+
+	sys_put_le16(received, &rsp[2]);
+	(void)bt_padlock_send_prov_result(rsp, sizeof(rsp));
+}
+
+static void journal_delete(uint8_t blocks)
+{
+	for (uint8_t i = 0; i < blocks; i++) {
+		(void)storage_delete(STORAGE_ID_PROV_BASE + i);
+	}
+}
+
+static void spill_work_fn(struct k_work *work)
+{
+	struct prov_stage *s = &stage[spill];
+	ssize_t rc;
+
+	rc = storage_write(STORAGE_ID_PROV_BASE + journal_blocks, s->rec,
+			   s->count * sizeof(s->rec[0]));
+	if (rc < 0) {
+		atomic_set(&spill_error, 1);
+	}
+
+	journal_blocks++;
+	s->count = 0;
+	atomic_set(&spill_busy, 0);
+}
+
+static K_WORK_DEFINE(spill_work, spill_work_fn);
+
+/* Read the journal back and apply it to the credential store. */
+static int journal_apply(const struct prov_marker *m)
+{
+	struct prov_stage *buf = &stage[0];
+	ssize_t rc;
+	int err;
+
+	if (m->flags & PROV_F_REPLACE) {
+		err = cred_clear();
+		if (err) {
+			return err;
+		}
+	}
+
+	for (uint8_t blk = 0; blk < m->blocks; blk++) {
+		rc = storage_read(STORAGE_ID_PROV_BASE + blk, buf->rec,
+				  sizeof(buf->rec));
+		if (rc < 0) {
+			return rc;
+		}
+
+		for (size_t i = 0; i < (rc / sizeof(buf->rec[0])); i++) {
+			err = cred_add(&buf->rec[i]);
+			if (err && (err != -EEXIST)) {
+				return err;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/* Also counts the records that are not stored yet, which need a slot. */
+static bool journal_verify(uint8_t blocks, uint16_t *count, uint16_t *fresh)
+{
+	struct prov_stage *buf = &stage[0];
+	struct auth_cmac cmac;
+	ssize_t rc;
+
+	*count = 0;
+	*fresh = 0;
+	auth_cmac_init(&cmac, begin_pad);
+
+	for (uint8_t blk = 0; blk < blocks; blk++) {
+		rc = storage_read(STORAGE_ID_PROV_BASE + blk, buf->rec,
+				  sizeof(buf->rec));
+		if ((rc < 0) ||
+		    auth_cmac_update(&cmac, (const uint8_t *)buf->rec, rc)) {
+			return false;
+		}
+
+		*count += rc / sizeof(buf->rec[0]);
+
+		for (size_t i = 0; i < (rc / sizeof(buf->rec[0])); i++) {
+			const struct cred_record *r = &buf->rec[i];
+
+			if (cred_lookup(r->type, r->secret, r->len, NULL) ==
+			    -ENOENT) {
+				(*fresh)++;
+			}
+		}
+	}
+
+	return auth_cmac_verify(&cmac, commit_mac);
+}
+
+static enum padlock_cmd_status commit(void)
+{
+	uint32_t apply_start;
+	uint16_t count;
+	uint16_t fresh;
+	ssize_t rc;
+
+	if (stage[fill].count) {
+		spill = fill;
+		spill_work_fn(NULL);
+	}
+
+	if (atomic_get(&spill_error)) {
+		return PADLOCK_CMD_STATUS_STORAGE_ERROR;
+	}
+
+	/* The single MAC check, over what actually reached the flash. */
+	if (!journal_verify(journal_blocks, &count, &fresh)) {
+		return PADLOCK_CMD_STATUS_AUTH_FAILED;
+	}
+	if (count != marker.count) {
+		return PADLOCK_CMD_STATUS_INVALID;
+	}
+
+	/* Records were validated as they came in, so only a full store can
+	 * still make the apply fail. Duplicates within the batch are counted
+	 * twice, which errs on the safe side.
+	 */
+	if (!(marker.flags & PROV_F_REPLACE) &&
+	    ((cred_count() + fresh) > CONFIG_PADLOCK_CRED_MAX)) {
+		return PADLOCK_CMD_STATUS_NO_SPACE;
+	}
+
+	marker.blocks = journal_blocks;
+	rc = storage_write(STORAGE_ID_PROV_COMMIT, &marker, sizeof(marker));
+	if (rc < 0) {
+		return PADLOCK_CMD_STATUS_STORAGE_ERROR;
+	}
+
+	/* From here on the transaction survives a power loss. */
+	apply_start = k_uptime_get_32();
+	if (journal_apply(&marker)) {
+		/* Keep marker and journal, prov_init() applies them again. */
+		replay_pending = true;
+		return PADLOCK_CMD_STATUS_STORAGE_ERROR;
+	}
+	stats.last_apply_ms = k_uptime_get_32() - apply_start;
+
+	return PADLOCK_CMD_STATUS_OK;
+}
+
+static void commit_work_fn(struct k_work *work)
+{
+	enum padlock_cmd_status status = commit();
+
+	memset(begin_pad, 0, sizeof(begin_pad));
+
+	/* Marker first: a journal without a marker is discarded at boot. */
+	if (!replay_pending) {
+		(void)storage_delete(STORAGE_ID_PROV_COMMIT);
+		journal_delete(journal_blocks);
+	}
+
+	if (status == PADLOCK_CMD_STATUS_OK) {
+		stats.committed++;
+		stats.last_records = marker.count;
+		stats.last_total_ms = k_uptime_get_32() - begin_time;
+	} else {
+		stats.failed++;
+	}
+
+	atomic_set(&state, PROV_STATE_IDLE);
+	prov_notify(PROV_OP_COMMIT, status);
+}
+
+static K_WORK_DEFINE(commit_work, commit_work_fn);
+
+void prov_init(void)
+{
+	struct prov_marker m;
+	ssize_t rc;
+
+	rc = storage_read(STORAGE_ID_PROV_COMMIT, &m, sizeof(m));
+	if (rc == sizeof(m)) {
+		/* Power was lost or the flash failed while applying, finish
+		 * the job. Applying twice gives the same result.
+		 */
+		if (journal_apply(&m)) {
+			replay_pending = true;
+			return;
+		}
+		(void)storage_delete(STORAGE_ID_PROV_COMMIT);
+	}
+
+	/* Also drops the journal of a transaction that never committed. */
+	journal_delete(PROV_JOURNAL_BLOCKS);
+}
+
+static int begin(const uint8_t *buf, uint16_t len)
+{
+	uint16_t count;
+
+	if (len != PROV_BEGIN_LEN) {
+		return -EINVAL;
+	}
+
+	count = sys_get_le16(&buf[2]);
+	if ((count == 0) || (count > CONFIG_PADLOCK_CRED_MAX)) {
+		return -EINVAL;
+	}
+
+	/* Wait for a spill of an abandoned transaction to finish. A batch
+	 * waiting for its replay must not have its journal overwritten.
+	 */
+	if (atomic_get(&spill_busy) || replay_pending) {
+		return -EBUSY;
+	}
+
+	if (!auth_verify_pad(buf, 4, &buf[4], begin_pad)) {
+		return -EACCES;
+	}
+
+	memset(&marker, 0, sizeof(marker));
+	marker.count = count;
+	marker.flags = buf[1];
+	received = 0;
+	journal_blocks = 0;
+	fill = 0;
+	stage[0].count = 0;
+	stage[1].count = 0;
+	atomic_set(&spill_error, 0);
+	begin_time = k_uptime_get_32();
+
+	atomic_set(&state, PROV_STATE_RECEIVING);
+
+	return 0;
+}
+
+static int data(const uint8_t *buf, uint16_t len)
+{
+	size_t n = (len - PROV_DATA_HDR_LEN) / sizeof(struct cred_record);
+
+	if ((len < (PROV_DATA_HDR_LEN + sizeof(struct cred_record))) ||
+	    ((len - PROV_DATA_HDR_LEN) % sizeof(struct cred_record)) ||
+	    (sys_get_le16(&buf[1]) != received) ||
+	    ((received + n) > marker.count)) {
+		return -EINVAL;
+	}
+
+	buf += PROV_DATA_HDR_LEN;
+
+	/* Reject the whole PDU before anything is staged, so the apply after
+	 * the commit marker cannot fail on a malformed record.
+	 */
+	for (size_t i = 0; i < n; i++) {
+		struct cred_record rec;
+
+		memcpy(&rec, &buf[i * sizeof(rec)], sizeof(rec));
+		if (!cred_record_valid(&rec)) {
+			return -EINVAL;
+		}
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		if (stage[fill].count == PROV_STAGE_RECORDS) {
+			if (atomic_get(&spill_busy)) {
+				return -ENOMEM;
+			}
+
+			spill = fill;
+			fill ^= 1;
+			atomic_set(&spill_busy, 1);
+			(void)storage_work_submit(&spill_work);
+		}
+
+		memcpy(&stage[fill].rec[stage[fill].count++], buf,
+		       sizeof(struct cred_record));
+		buf += sizeof(struct cred_record);
+		received++;
+	}
+
+	return 0;
+}
+
+int prov_write(const uint8_t *buf, uint16_t len)
+{
+	uint8_t op = (len > 0) ? buf[0] : 0;
+	int err;
+
+	if (atomic_get(&state) == PROV_STATE_COMMITTING) {
+		prov_notify(op, PADLOCK_CMD_STATUS_BUSY);
+		return -EBUSY;
+	}
+
+	switch (op) {
+	case PROV_OP_BEGIN:
+		err = begin(buf, len);
+		break;
+
+	case PROV_OP_DATA:
+		err = (atomic_get(&state) == PROV_STATE_RECEIVING) ?
+		      data(buf, len) : -EINVAL;
+		if (!err) {
+			/* Streaming, only problems are notified. */
+			return 0;
+		}
+		break;
+
+	case PROV_OP_COMMIT:
+		if ((atomic_get(&state) != PROV_STATE_RECEIVING) ||
+		    (len != PROV_COMMIT_LEN) || (received != marker.count)) {
+			err = -EINVAL;
+			break;
+		}
+
+		memcpy(commit_mac, &buf[1], sizeof(commit_mac));
+		atomic_set(&state, PROV_STATE_COMMITTING);
+		(void)storage_work_submit(&commit_work);
+		return 0;
+
+	case PROV_OP_ABORT:
+		atomic_set(&state, PROV_STATE_IDLE);
+		stats.failed++;
+		err = 0;
+		break;
+
+	default:
+		err = -EINVAL;
+		break;
+	}
+
+	switch (err) {
+	case 0:
+		prov_notify(op, PADLOCK_CMD_STATUS_OK);
+		break;
+	case -EACCES:
+		prov_notify(op, PADLOCK_CMD_STATUS_AUTH_FAILED);
+		break;
+	case -ENOMEM:
+		prov_notify(op, PADLOCK_CMD_STATUS_QUEUE_FULL);
+		break;
+	case -EBUSY:
+		prov_notify(op, PADLOCK_CMD_STATUS_BUSY);
+		break;
+	default:
+		prov_notify(op, PADLOCK_CMD_STATUS_INVALID);
+		break;
+	}
+
+	return err;
+}
+
+void prov_get_stats(struct prov_stats *out)
+{
+	*out = stats;
+}
+
+static void disconnected(struct bt_conn *conn, uint8_t reason)
+{
+	/* A commit already queued runs to completion. */
+	if (atomic_cas(&state, PROV_STATE_RECEIVING, PROV_STATE_IDLE)) {
+		stats.failed++;
+	}
+}
+
+BT_CONN_CB_DEFINE(prov_conn_callbacks) = {
+	.disconnected = disconnected,
+};
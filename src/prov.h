@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef PROV_H_
+#define PROV_H_
+
+/**@file
+ * @defgroup prov Credential provisioning
+ * @{
+ * @brief Bulk credential provisioning transaction.
+ *
+ * A client streams credential records over the Provisioning
+ * characteristic, preferably with write without response:
+ *
+ * - BEGIN:  0x01, flags, record count (LE16), MAC (see auth.h) over the
+ *           nonce and the first four bytes of the PDU.
+ * - DATA:   0x02, index of the first record (LE16), one or more 16 byte
+ *           struct cred_record.
+ * - COMMIT: 0x03, MAC over the BEGIN nonce and all records in order,
+ *           AES-CMAC(key, nonce || records) truncated to AUTH_MAC_LEN.
+ * - ABORT:  0x04.
+ *
+ * Each record is validated when its DATA PDU arrives. Records are staged
+ * in RAM and spilled to a journal in flash as the staging buffers fill
+ * up. COMMIT checks the MAC over the journal once and that the store has
+ * room for the new records. Only then does it write a commit marker and
+ * apply all records to the credential store. A wrong MAC fails the commit
+ * with PADLOCK_CMD_STATUS_AUTH_FAILED. A commit interrupted by a
+ * power loss or a flash error keeps its marker and is replayed at boot,
+ * so a transaction is applied completely or not at all. Until then,
+ * BEGIN is refused with PADLOCK_CMD_STATUS_BUSY.
+ *
+ * The lock notifies { op, status, records received (LE16) } after BEGIN,
+ * COMMIT and ABORT, and after a DATA PDU that could not be accepted. The
+ * status is a #padlock_cmd_status. After PADLOCK_CMD_STATUS_QUEUE_FULL
+ * the client resumes from the notified record index.
+ */
+
+#include <zephyr/types.h>
+
+/** Replace all stored credentials instead of adding to them. */
+#define PROV_F_REPLACE		BIT(0)
+
+/** @brief Provisioning statistics. */
+struct prov_stats {
+	/** Transactions committed. */
+	uint32_t committed;
+	/** Transactions aborted or failed. */
+	uint32_t failed;
+	/** Records applied by the last committed transaction. */
+	uint32_t last_records;
+	/** Time from BEGIN to applied, of the last transaction, in ms. */
+	uint32_t last_total_ms;
+	/** Time spent applying the last transaction to the store, in ms. */
+	uint32_t last_apply_ms;
+};
+
+/** @brief Replay or discard an interrupted transaction.
+ *
+ * Must be called after cred_init().
+ */
+void prov_init(void);
+
+/** @brief Handle a PDU written to the Provisioning characteristic.
+ *
+ * @param buf PDU.
+ * @param len Length of @p buf.
+ *
+ * @retval 0 If the PDU was accepted.
+ * @retval -EINVAL If the PDU is malformed or out of sequence.
+ * @retval -EACCES If the BEGIN MAC did not verify.
+ * @retval -ENOMEM If the staging buffers are full.
+ * @retval -EBUSY If a commit is in progress or waits for its replay.
+ */
+int prov_write(const uint8_t *buf, uint16_t len);
+
+/** @brief Get a snapshot of the provisioning statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void prov_get_stats(struct prov_stats *stats);
+
+/**
+ * @}
+ */
+
+#endif /* PROV_H_ */
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/fs/nvs.h>
+#include <errno.h>
+#include <string.h>
+
+#include "storage.h"
+
+#define NVS_PARTITION		storage_partition
+#define NVS_PARTITION_DEVICE	FIXED_PARTITION_DEVICE(NVS_PARTITION)
+#define NVS_PARTITION_OFFSET	FIXED_PARTITION_OFFSET(NVS_PARTITION)
+#define NVS_PARTITION_SIZE	FIXED_PARTITION_SIZE(NVS_PARTITION)
+
+/* NVS addresses carry the sector number in the upper half word. */
+#define NVS_ADDR_SECTOR(addr)	((addr) >> 16)
+
+static struct nvs_fs fs;
+static struct storage_stats stats;
+
+static K_THREAD_STACK_DEFINE(storage_stack, CONFIG_PADLOCK_STORAGE_STACK_SIZE);
+static struct k_work_q storage_workq;
+
+static void gc_work_handler(struct k_work *work);
+
+static K_WORK_DELAYABLE_DEFINE(gc_work, gc_work_handler);
+
+static uint32_t sector_free(void)
+{
+	return fs.ate_wra - fs.data_wra;
+}
+
+/* Each write pushes the idle check back, so it only runs once the flash
+ * has been left alone for a while.
+ */
+static void gc_idle_restart(void)
+{
+	k_work_reschedule_for_queue(&storage_workq, &gc_work,
+				    K_MSEC(CONFIG_PADLOCK_STORAGE_GC_IDLE_MS));
+}
+
+/* NVS only collects garbage when a write does not fit in the current
+ * sector. When the sector is nearly full, write a filler entry that is
+ * just too large for it, so the sector is closed and the next one is
+ * collected now instead of inside the next command.
+ */
+static void gc_work_handler(struct k_work *work)
+{
+	uint8_t filler[CONFIG_PADLOCK_STORAGE_GC_THRESHOLD];
+	uint32_t sector = NVS_ADDR_SECTOR(fs.ate_wra);
+	uint32_t free = sector_free();
+	ssize_t rc;
+
+	if (free >= sizeof(filler)) {
+		return;
+	}
+
+	memset(filler, 0xFF, sizeof(filler));
+
+	rc = nvs_write(&fs, STORAGE_ID_GC_FILLER, filler, MAX(free, 1U));
+	if (rc < 0) {
+		printk("Idle GC failed (err %d)\n", (int)rc);
+		return;
+	}
+
+	(void)nvs_delete(&fs, STORAGE_ID_GC_FILLER);
+
+	if (NVS_ADDR_SECTOR(fs.ate_wra) != sector) {
+		stats.gc_idle++;
+	}
+}
+
+int storage_init(void)
+{
+	int rc = 0;
+	struct flash_pages_info info;
+
+	fs.flash_device = NVS_PARTITION_DEVICE;
+	if (!device_is_ready(fs.flash_device)) {
+		printk("Flash device %s is not ready\n", fs.flash_device->name);
+		return -EINVAL;
+	}
+	fs.offset = NVS_PARTITION_OFFSET;
+	rc = flash_get_page_info_by_offs(fs.flash_device, fs.offset, &info);
+	if (rc) {
+		printk("Unable to get page info\n");
+		return  -EINVAL;
+	}
+	fs.sector_size = info.size;
+	fs.sector_count = NVS_PARTITION_SIZE / info.size;
+
+	rc = nvs_mount(&fs);
+	if (rc) {
+		printk("Flash Init failed\n");
+		return  -EINVAL;
+	}
+
+	k_work_queue_start(&storage_workq, storage_stack,
+			   K_THREAD_STACK_SIZEOF(storage_stack),
+			   CONFIG_PADLOCK_STORAGE_THREAD_PRIO, NULL);
+
+	gc_idle_restart();
+
+	return 0;
+}
+
+int storage_work_submit(struct k_work *work)
+{
+	return k_work_submit_to_queue(&storage_workq, work);
+}
+
+int storage_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+	return k_work_schedule_for_queue(&storage_workq, dwork, delay);
+}
+
+int storage_work_reschedule(struct k_work_delayable *dwork,
+			    k_timeout_t delay)
+{
+	return k_work_reschedule_for_queue(&storage_workq, dwork, delay);
+}
+
+void storage_work_drain(void)
+{
+	(void)k_work_queue_drain(&storage_workq, false);
+}
+
+ssize_t storage_read(uint16_t id, void *data, size_t len)
+{
+	return nvs_read(&fs, id, data, len);
+}
+
+ssize_t storage_write(uint16_t id, const void *data, size_t len)
+{
+	uint32_t sector = NVS_ADDR_SECTOR(fs.ate_wra);
+	uint32_t start = k_cycle_get_32();
+	uint32_t us;
+	ssize_t rc;
+
+	rc = nvs_write(&fs, id, data, len);
+
+	us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+	stats.writes++;
+	if (us > stats.write_max_us) {
+		stats.write_max_us = us;
+	}
+	if (NVS_ADDR_SECTOR(fs.ate_wra) != sector) {
+		stats.gc_in_write++;
+	}
+
+	gc_idle_restart();
+
+	return rc;
+}
+
+int storage_delete(uint16_t id)
+{
+	int rc;
+
+	rc = nvs_delete(&fs, id);
+
+	gc_idle_restart();
+
+	return rc;
+}
+
+void storage_get_stats(struct storage_stats *out)
+{
+	*out = stats;
+	out->sector_free = sector_free();
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2023 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ */
+
+#ifndef STORAGE_H_
+#define STORAGE_H_
+
+/**@file
+ * @defgroup storage Persistent storage
+ * @{
+ * @brief NVS file system on the storage partition.
+ *
+ * All persistent data of the application goes through this module. The
+ * NVS ids are allocated here so the users cannot collide.
+ *
+ * Long running flash work, which may stall on an erase, runs on the
+ * storage work queue at low priority instead of the system work queue.
+ * Garbage collection is also started from there once the flash has been
+ * idle for CONFIG_PADLOCK_STORAGE_GC_IDLE_MS, so that it rarely has to run
+ * inside a write.
+ */
+
+#include <zephyr/kernel.h>
+#include <sys/types.h>
+
+/** @brief Shared key, used by the keypad and BLE. */
+#define STORAGE_ID_KEY		1
+/** @brief Auto close setting. */
+#define STORAGE_ID_AUTO_CLOSE	2
+/** @brief First of CONFIG_PADLOCK_CRED_MAX credential records. */
+#define STORAGE_ID_CRED_BASE	0x1000
+/** @brief First block of the provisioning journal. */
+#define STORAGE_ID_PROV_BASE	0x2000
+/** @brief Provisioning commit marker. */
+#define STORAGE_ID_PROV_COMMIT	0x2FFF
+/** @brief Filler entry used to start garbage collection while idle. */
+#define STORAGE_ID_GC_FILLER	0x3000
+/** @brief First block of the audit log. */
+#define STORAGE_ID_AUDIT_BASE	0x3100
+/** @brief End of the audit log range. */
+#define STORAGE_ID_AUDIT_END	0x3200
+
+/** @brief Storage statistics. */
+struct storage_stats {
+	/** Number of storage_write() calls. */
+	uint32_t writes;
+	/** Worst case storage_write() duration, in microseconds. */
+	uint32_t write_max_us;
+	/** Writes that had to close a sector and collect garbage. */
+	uint32_t gc_in_write;
+	/** Garbage collections run ahead of time while idle. */
+	uint32_t gc_idle;
+	/** Bytes left in the sector currently written. */
+	uint32_t sector_free;
+};
+
+/** @brief Mount the file system.
+ *
+ * The file system uses every page of the storage partition.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int storage_init(void);
+
+/** @brief Read an entry.
+ *
+ * @param id Entry id.
+ * @param data Buffer for the entry.
+ * @param len Size of @p data.
+ *
+ * @return Length of the stored entry, or a negative error code.
+ */
+ssize_t storage_read(uint16_t id, void *data, size_t len);
+
+/** @brief Write an entry.
+ *
+ * Nothing is written if the stored entry already has the same content.
+ *
+ * @param id Entry id.
+ * @param data Entry content.
+ * @param len Length of @p data.
+ *
+ * @return Number of bytes written, 0 if unchanged, or a negative error
+ *	   code.
+ */
+ssize_t storage_write(uint16_t id, const void *data, size_t len);
+
+/** @brief Delete an entry.
+ *
+ * @param id Entry id.
+ *
+ * @retval 0 If the operation was successful.
+ *           Otherwise, a (negative) error code is returned.
+ */
+int storage_delete(uint16_t id);
+
+/** @brief Submit a work item to the storage work queue.
+ *
+ * @param work Work item.
+ *
+ * @return See k_work_submit_to_queue().
+ */
+int storage_work_submit(struct k_work *work);
+
+/** @brief Schedule a delayable work item on the storage work queue.
+ *
+ * An already scheduled item keeps its original deadline.
+ *
+ * @param dwork Work item.
+ * @param delay Delay before the item runs.
+ *
+ * @return See k_work_schedule_for_queue().
+ */
+int storage_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay);
+
+/** @brief Reschedule a delayable work item on the storage work queue.
+ *
+ * Replaces the deadline of an already scheduled item.
+ *
+ * @param dwork Work item.
+ * @param delay Delay before the item runs.
+ *
+ * @return See k_work_reschedule_for_queue().
+ */
+int storage_work_reschedule(struct k_work_delayable *dwork,
+			    k_timeout_t delay);
+
+/** @brief Get a snapshot of the storage statistics.
+ *
+ * @param[out] stats Filled with the current statistics.
+ */
+void storage_get_stats(struct storage_stats *stats);
+
+/** @brief Wait until the storage work queue is empty.
+ *
+ * Delayable work that has not expired yet is not waited for.
+ */
+void storage_work_drain(void);
+
+/**
+ * @}
+ */
+
+#endif /* STORAGE_H_ */